@@ -0,0 +1,127 @@
+#include "conversion.hpp"
+
+#include <limits>
+#include <string>
+
+namespace reflect
+{
+    namespace
+    {
+        // Whether every `From` converts to a `To` of the same value, e.g. int to double but not
+        // double to int, int to unsigned or anything but bool to bool.
+        template<typename From, typename To>
+        constexpr bool IsValuePreserving()
+        {
+            using FromLimits = std::numeric_limits<From>;
+            using ToLimits   = std::numeric_limits<To>;
+            if constexpr (std::is_same_v<To, bool>)
+            {
+                return std::is_same_v<From, bool>;
+            }
+            else if constexpr (std::is_same_v<From, bool>)
+            {
+                return true;
+            }
+            else if constexpr ((!FromLimits::is_integer && ToLimits::is_integer) ||
+                               (FromLimits::is_signed && !ToLimits::is_signed))
+            {
+                return false;
+            }
+            else
+            {
+                return ToLimits::digits >= FromLimits::digits && ToLimits::max_exponent >= FromLimits::max_exponent;
+            }
+        }
+
+        template<typename From, typename... Tos>
+        void RegisterCastsFrom(ConversionRegistry& registry)
+        {
+            (
+                [&registry] {
+                    if constexpr (!std::is_same_v<From, Tos> && IsValuePreserving<From, Tos>())
+                    {
+                        registry.RegisterCast<From, Tos>();
+                    }
+                }(),
+                ...);
+        }
+
+        template<typename... Ts>
+        void RegisterCastsBetween(ConversionRegistry& registry)
+        {
+            (RegisterCastsFrom<Ts, Ts...>(registry), ...);
+        }
+    } // namespace
+
+    ConversionRegistry::ConversionRegistry()
+    {
+        RegisterCastsBetween<bool,
+                             char,
+                             signed char,
+                             unsigned char,
+                             short,
+                             unsigned short,
+                             int,
+                             unsigned int,
+                             long,
+                             unsigned long,
+                             long long,
+                             unsigned long long,
+                             float,
+                             double,
+                             long double>(*this);
+        RegisterCast<const char*, std::string>();
+        RegisterCast<char*, std::string>();
+        RegisterCast<const char*, std::string_view>();
+        RegisterCast<std::string_view, std::string>();
+        RegisterCast<std::string, std::string_view>();
+    }
+
+    Converter ConversionRegistry::Find(TypeId from, TypeId to) const
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        auto                        from_it = m_indices.find(from);
+        auto                        to_it   = m_indices.find(to);
+        if (from_it == m_indices.end() || to_it == m_indices.end())
+        {
+            return Converter {};
+        }
+        return m_table[from_it->second * m_stride + to_it->second];
+    }
+
+    void ConversionRegistry::Add(TypeId from, TypeId to, Converter converter)
+    {
+        std::lock_guard<std::mutex> lock {m_mutex};
+        const uint32_t              from_index = IndexOf(from);
+        const uint32_t              to_index   = IndexOf(to);
+        m_table[from_index * m_stride + to_index] = converter;
+    }
+
+    uint32_t ConversionRegistry::IndexOf(TypeId type)
+    {
+        auto it = m_indices.find(type);
+        if (it != m_indices.end())
+        {
+            return it->second;
+        }
+        const auto index = static_cast<uint32_t>(m_indices.size());
+        if (index == m_stride)
+        {
+            // Grow to twice as many types, keeping the converters in place.
+            const uint32_t         stride = m_stride == 0 ? 16 : 2 * m_stride;
+            std::vector<Converter> table(static_cast<std::size_t>(stride) * stride);
+            for (uint32_t row = 0; row < m_stride; row++)
+            {
+                for (uint32_t col = 0; col < m_stride; col++)
+                {
+                    table[row * stride + col] = m_table[row * m_stride + col];
+                }
+            }
+            m_table.swap(table);
+            m_stride = stride;
+        }
+        m_indices.emplace(type, index);
+        return index;
+    }
+
+} // namespace reflect
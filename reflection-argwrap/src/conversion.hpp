@@ -0,0 +1,117 @@
+#pragma once
+
+#include "type_id.hpp"
+#include "value.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace reflect
+{
+
+    // Makes a `To` in `to` from the `From` at `from`. `user` is the function a conversion was
+    // registered with, if any, as a generic function pointer.
+    struct Converter
+    {
+        void (*call)(void (*user)(), const void* from, Value& to) {nullptr};
+        void (*user)() {nullptr};
+
+        explicit operator bool() const { return call != nullptr; }
+
+        void operator()(const void* from, Value& to) const { call(user, from, to); }
+    };
+
+    namespace details
+    {
+
+        template<typename From, typename To>
+        void CastConversion(void (*)(), const void* from, Value& to)
+        {
+            to.Emplace<To>(static_cast<To>(*static_cast<const From*>(from)));
+        }
+
+        template<typename From, typename To>
+        void UserConversion(void (*user)(), const void* from, Value& to)
+        {
+            auto* convert = reinterpret_cast<To (*)(const From&)>(user);
+            to.Emplace<To>(convert(*static_cast<const From*>(from)));
+        }
+
+        // A copy of a `T`; empty if `T` cannot be copied.
+        template<typename T>
+        constexpr Converter CopyConverter()
+        {
+            if constexpr (std::is_copy_constructible_v<T>)
+            {
+                return Converter {&CastConversion<T, T>, nullptr};
+            }
+            else
+            {
+                return Converter {};
+            }
+        }
+
+    } // namespace details
+
+    // Conversions of arguments to parameter types that differ from theirs, e.g. from `int` to
+    // `double` or from `const char*` to `std::string`. Value-preserving conversions between
+    // arithmetic types and those between `const char*`, `std::string_view` and `std::string` are
+    // built in. Narrowing ones, e.g. `double` to `int`, have to be registered, as with
+    // `ConversionRegistry::instance().RegisterCast<double, int>()`.
+    //
+    // Types get dense indices as they are first seen, and converters are kept in a square table
+    // indexed by the source and target indices.
+    class ConversionRegistry
+    {
+    public:
+        static ConversionRegistry& instance()
+        {
+            static ConversionRegistry inst;
+            return inst;
+        }
+
+        // Replaces any conversion between the same types.
+        template<typename From, typename To>
+        void Register(To (*convert)(const From&))
+        {
+            Add(GetTypeId<From>(),
+                GetTypeId<To>(),
+                Converter {&details::UserConversion<From, To>, reinterpret_cast<void (*)()>(convert)});
+        }
+
+        // A conversion by `static_cast<To>`.
+        template<typename From, typename To>
+        void RegisterCast()
+        {
+            Add(GetTypeId<From>(), GetTypeId<To>(), Converter {&details::CastConversion<From, To>, nullptr});
+        }
+
+        // An empty Converter if there is none.
+        Converter Find(TypeId from, TypeId to) const;
+
+    private:
+        ConversionRegistry();
+
+        void Add(TypeId from, TypeId to, Converter converter);
+
+        uint32_t IndexOf(TypeId type);
+
+        mutable std::mutex                               m_mutex;
+        std::unordered_map<TypeId, uint32_t, TypeIdHash> m_indices;
+        // Row `from`, column `to`, with room for `m_stride` types.
+        std::vector<Converter> m_table;
+        uint32_t               m_stride {0};
+    };
+
+    // E.g. `RegisterConversion(+[](const int& i) { return Meters {i}; })`.
+    template<typename From, typename To>
+    void RegisterConversion(To (*convert)(const From&))
+    {
+        ConversionRegistry::instance().Register(convert);
+    }
+
+} // namespace reflect
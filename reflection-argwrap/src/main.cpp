@@ -1,4 +1,6 @@
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
 #include "reflect.hpp"
 
@@ -52,14 +54,13 @@ void TestMemberFunction()
     foo_pass_by_val.Invoke(f, hello_s);
 
     MemberFunction foo_pass_by_cref {&Foo::PassByConstRef};
-    foo_pass_by_cref.Invoke(f, hello_s); // Crash, value
-    // foo_pass_by_cref.Invoke(f, std::ref(hello_s));  // Crash, non-const ref
-    foo_pass_by_cref.Invoke(f, std::cref(hello_s)); // OK: const ref
+    foo_pass_by_cref.Invoke(f, hello_s);
+    foo_pass_by_cref.Invoke(f, std::ref(hello_s));
+    foo_pass_by_cref.Invoke(f, std::cref(hello_s));
 
     MemberFunction foo_concat {&Foo::Concat};
-    // foo_concat.Invoke(f, std::cref(hello_s), world_s);
-    auto res = foo_concat.Invoke(f, std::cref(hello_s), std::cref(world_s));
-    std::cout << "Concat got: " << std::any_cast<std::string>(res) << std::endl;
+    auto           res = foo_concat.Invoke(f, std::cref(hello_s), "!"); // const char* converted
+    std::cout << "Concat got: " << reflect::ValueCast<std::string>(res) << std::endl;
 
     std::cout << "<<< TestMemberFunction OK\n" << std::endl;
 }
@@ -85,6 +86,92 @@ void TestMemberVariable()
     std::cout << "<<< TestMemberVariable OK\n" << std::endl;
 }
 
+bool g_failed = false;
+
+void Expect(bool ok, const std::string& what)
+{
+    std::cout << what << ": " << (ok ? "ok" : "FAILED") << std::endl;
+    g_failed = g_failed || !ok;
+}
+
+// Expects `call` to throw std::runtime_error.
+template<typename Call>
+void ExpectRejected(Call call, const std::string& what)
+{
+    try
+    {
+        call();
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cout << what << ": rejected (" << e.what() << ")" << std::endl;
+        return;
+    }
+    Expect(false, what);
+}
+
+struct Meters
+{
+    double value {0.0};
+};
+
+class Gauge
+{
+public:
+    void Add(double v) { total += v; }
+
+    int Scale(int v) const { return v * 10; }
+
+    void Append(std::string& s) const { s += "!"; }
+
+    double total {0.0};
+};
+
+void TestConversions()
+{
+    std::cout << ">>> TestConversions" << std::endl;
+    using namespace reflect;
+    Gauge g;
+
+    MemberFunction gauge_add {&Gauge::Add};
+    gauge_add.Invoke(g, 2); // int to double is built in
+    Expect(g.total == 2.0, "int to double");
+
+    MemberFunction gauge_scale {&Gauge::Scale};
+    // Narrowing, so not built in.
+    ExpectRejected([&] { gauge_scale.Invoke(g, 2.5); }, "double to int without a converter");
+    ConversionRegistry::instance().RegisterCast<double, int>();
+    Expect(ValueCast<int>(gauge_scale.Invoke(g, 2.5)) == 20, "double to int after RegisterCast");
+
+    RegisterConversion(+[](const Meters& m) { return m.value; });
+    gauge_add.Invoke(g, Meters {3.0});
+    Expect(g.total == 5.0, "Meters to double after RegisterConversion");
+
+    // Two argument-type signatures so far; repeated calls, also through a copy, reuse their plans.
+    MemberFunction gauge_add_copy = gauge_add;
+    for (int i = 0; i < 3; i++)
+    {
+        gauge_add.Invoke(g, 1);
+        gauge_add_copy.Invoke(g, Meters {1.0});
+    }
+    Expect(g.total == 11.0 && gauge_add.num_plans() == 2, "cached plans reused");
+    gauge_add.Invoke(g, 1.0f);
+    Expect(g.total == 12.0 && gauge_add_copy.num_plans() == 3, "new signature adds a plan");
+
+    MemberFunction gauge_append {&Gauge::Append};
+    std::string       s {"hi"};
+    const std::string cs {"hi"};
+    gauge_append.Invoke(g, s);
+    Expect(s == "hi!", "std::string to std::string&");
+    ExpectRejected([&] { gauge_append.Invoke(g, cs); }, "const std::string to std::string&");
+    ExpectRejected([&] { gauge_append.Invoke(g, std::cref(s)); }, "std::cref to std::string&");
+    ExpectRejected([&] { gauge_append.Invoke(g, "hi"); }, "const char* to std::string&");
+    ExpectRejected([&] { gauge_add.Invoke(g, s); }, "std::string to double");
+    Expect(gauge_append.num_plans() == 1, "rejected signatures not cached");
+
+    std::cout << "<<< TestConversions OK\n" << std::endl;
+}
+
 void TestFoo()
 {
     std::cout << ">>> TestFoo\n" << std::endl;
@@ -115,31 +202,34 @@ void TestFoo()
     // Test member functions
     auto foo_make_float_ptr = foo_t.GetMemberFunc("MakeFloatPtr");
     auto res                = foo_make_float_ptr.Invoke(f, 123.4f);
-    auto float_sptr         = std::any_cast<std::shared_ptr<float>>(res);
+    auto float_sptr         = reflect::ValueCast<std::shared_ptr<float>>(res);
     std::cout << "MakeFloatPtr res: " << *float_sptr << std::endl;
 
     std::string hello_s {"hello"};
     std::string world_s {" world"};
 
-    //auto foo_pass_by_val = foo_t.GetMemberFunc("PassByValue");
-    //foo_pass_by_val.Invoke(f, hello_s);
+    auto foo_pass_by_val = foo_t.GetMemberFunc("PassByValue");
+    foo_pass_by_val.Invoke(f, hello_s);
 
     auto foo_pass_by_cref = foo_t.GetMemberFunc("PassByConstRef");
-    //foo_pass_by_cref.Invoke(f, hello_s); // Ok
-    //f.PassByConstRef(std::ref(hello_s)); // Ok
-    foo_pass_by_cref.Invoke(f, std::ref(hello_s));  // Crash, parameter cast to null
-    // foo_pass_by_cref.Invoke(f, std::cref(hello_s)); // Crash, parameter cast to null
-
-    //auto foo_concat = foo_t.GetMemberFunc("Concat");
-    //foo_concat.Invoke(f, hello_s, world_s);
-    //res = foo_concat.Invoke(f, hello_s, hello_s);
-    //// res = foo_concat.Invoke(f, hello_s, hello_s); // Crash, parameter cast to null
-    //std::cout << "Concat got: " << std::any_cast<std::string>(res) << std::endl;
-    //std::cout << std::endl;
-
-    //std::cout << "<<< TestFoo OK\n" << std::endl;
+    foo_pass_by_cref.Invoke(f, hello_s);
+    foo_pass_by_cref.Invoke(f, std::ref(hello_s));
+    foo_pass_by_cref.Invoke(f, std::cref(hello_s));
+
+    auto foo_concat = foo_t.GetMemberFunc("Concat");
+    foo_concat.Invoke(f, hello_s, world_s);
+    res = foo_concat.Invoke(f, hello_s, hello_s);
+    std::cout << "Concat got: " << reflect::ValueCast<std::string>(res) << std::endl;
+    std::cout << std::endl;
+
+    std::cout << "<<< TestFoo OK\n" << std::endl;
 }
 
-int main() { 
+int main()
+{
+    TestMemberFunction();
+    TestMemberVariable();
+    TestConversions();
     TestFoo();
+    return g_failed ? 1 : 0;
 }
@@ -4,6 +4,71 @@
 
 namespace reflect
 {
+    CallPlanCache::~CallPlanCache()
+    {
+        const CallPlan* plan = m_head.load(std::memory_order_relaxed);
+        while (plan != nullptr)
+        {
+            const CallPlan* next = plan->next;
+            delete plan;
+            plan = next;
+        }
+    }
+
+    const CallPlan* CallPlanCache::Insert(std::unique_ptr<CallPlan> plan)
+    {
+        const CallPlan* head = m_head.load(std::memory_order_relaxed);
+        do
+        {
+            // Another thread may have built the same plan meanwhile; both work.
+            plan->next = head;
+        } while (!m_head.compare_exchange_weak(head, plan.get(), std::memory_order_release, std::memory_order_relaxed));
+        return plan.release();
+    }
+
+    std::unique_ptr<CallPlan> MemberFunction::BuildPlan(const void* key, const ArgType* args) const
+    {
+        auto plan = std::make_unique<CallPlan>();
+        plan->key = key;
+        plan->steps.resize(m_args_number);
+        for (int i = 0; i < m_args_number; i++)
+        {
+            const ParamType& param = m_params[i];
+            const ArgType&   arg   = args[i];
+            if (arg.value_type == param.value_type)
+            {
+                if (param.is_mutable_ref && arg.is_const)
+                {
+                    throw std::runtime_error("Cannot cast const-ref to non-const ref");
+                }
+                if (param.is_rvalue_ref && !(arg.is_rvalue && !arg.is_const))
+                {
+                    // Moves from a copy rather than from the caller's object.
+                    if (!param.copy)
+                    {
+                        throw std::runtime_error("Cannot copy `" + std::string {param.name} + "` to pass it as rvalue");
+                    }
+                    plan->steps[i] = param.copy;
+                }
+                continue;
+            }
+
+            Converter convert = ConversionRegistry::instance().Find(arg.value_type, param.value_type);
+            if (!convert)
+            {
+                throw std::runtime_error("No conversion from `" + std::string {arg.name} + "` to `" +
+                                         std::string {param.name} + "`");
+            }
+            if (param.is_mutable_ref)
+            {
+                throw std::runtime_error("Cannot bind a converted `" + std::string {arg.name} + "` to non-const `" +
+                                         std::string {param.name} + "&`");
+            }
+            plan->steps[i] = convert;
+        }
+        return plan;
+    }
+
     RawTypeDescriptorBuilder::RawTypeDescriptorBuilder(const std::string& name)
         : desc_(std::make_unique<TypeDescriptor>())
     {
@@ -1,12 +1,18 @@
 #pragma once
 
-#include "argwrap.hpp"
+#include "conversion.hpp"
+#include "type_id.hpp"
+#include "value.hpp"
 
-#include <any>
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
@@ -21,12 +27,12 @@ namespace reflect
         template<typename C, typename T>
         MemberVariable(T C::*var)
         {
-            getter_ = [var](std::any obj) -> std::any { return std::any_cast<const C*>(obj)->*var; };
-            setter_ = [var](std::any obj, std::any val) {
+            getter_ = [var](Value obj) -> Value { return ValueCast<const C*>(obj)->*var; };
+            setter_ = [var](Value obj, Value val) {
                 // Syntax: https://stackoverflow.com/a/670744/12003165
                 // `obj.*member_var`
-                auto* self = std::any_cast<C*>(obj);
-                self->*var = std::any_cast<T>(val);
+                auto* self = ValueCast<C*>(obj);
+                self->*var = ValueCast<T>(val);
             };
         }
 
@@ -35,7 +41,7 @@ namespace reflect
         template<typename T, typename C>
         T GetValue(const C& c) const
         {
-            return std::any_cast<T>(getter_(&c));
+            return ValueCast<T>(getter_(&c));
         }
 
         template<typename C, typename T>
@@ -47,11 +53,210 @@ namespace reflect
     private:
         friend class RawTypeDescriptorBuilder;
 
-        std::string                             m_name;
-        std::function<std::any(std::any)>       getter_ {nullptr};
-        std::function<void(std::any, std::any)> setter_ {nullptr};
+        std::string                       m_name;
+        std::function<Value(Value)>       getter_ {nullptr};
+        std::function<void(Value, Value)> setter_ {nullptr};
+    };
+
+    // A parameter of a reflected member function.
+    struct ParamType
+    {
+        // Without references and const, e.g. `std::string` for `const std::string&`.
+        TypeId           value_type;
+        std::string_view name;
+        bool             is_mutable_ref {false};
+        bool             is_rvalue_ref {false};
+        // Copies a `value_type`, for `T&&` parameters given lvalues.
+        Converter copy;
+    };
+
+    template<typename Arg>
+    constexpr ParamType MakeParamType()
+    {
+        using Raw = std::remove_cv_t<std::remove_reference_t<Arg>>;
+        return ParamType {GetTypeId<Raw>(),
+                          GetTypeName<Raw>(),
+                          std::is_lvalue_reference_v<Arg> && !std::is_const_v<std::remove_reference_t<Arg>>,
+                          std::is_rvalue_reference_v<Arg>,
+                          details::CopyConverter<Raw>()};
+    }
+
+    template<typename... Args>
+    inline constexpr std::array<ParamType, sizeof...(Args)> kParamTypes = {MakeParamType<Args>()...};
+
+    // An argument given to MemberFunction::Invoke, after unwrapping std::ref and std::cref.
+    struct ArgType
+    {
+        TypeId           value_type;
+        std::string_view name;
+        bool             is_const {false};
+        // Given as an rvalue, so it may be moved from.
+        bool is_rvalue {false};
+    };
+
+    template<typename T>
+    struct ArgTarget
+    {
+        using type = T;
+    };
+
+    template<typename T>
+    struct ArgTarget<std::reference_wrapper<T>>
+    {
+        using type = T;
+    };
+
+    template<typename T>
+    struct ArgTarget<const std::reference_wrapper<T>>
+    {
+        using type = T;
+    };
+
+    template<typename Arg>
+    constexpr ArgType MakeArgType()
+    {
+        using Given  = std::remove_reference_t<Arg>;
+        using Target = typename ArgTarget<Given>::type;
+        using Raw    = std::remove_cv_t<Target>;
+        return ArgType {GetTypeId<Raw>(),
+                        GetTypeName<Raw>(),
+                        std::is_const_v<Target>,
+                        !std::is_reference_v<Arg> && std::is_same_v<Given, Target>};
+    }
+
+    template<typename... Args>
+    inline constexpr std::array<ArgType, sizeof...(Args)> kArgTypes = {MakeArgType<Args>()...};
+
+    template<typename T>
+    void* ArgAddress(T& arg)
+    {
+        if constexpr (std::is_same_v<typename ArgTarget<T>::type, T>)
+        {
+            return const_cast<void*>(static_cast<const void*>(std::addressof(arg)));
+        }
+        else
+        {
+            return const_cast<void*>(static_cast<const void*>(std::addressof(arg.get())));
+        }
+    }
+
+    // Arrays, e.g. string literals, are passed as pointers. The pointer is a temporary that lives
+    // until the end of the Invoke call.
+    template<typename T>
+    decltype(auto) DecayArray(T&& arg)
+    {
+        if constexpr (std::is_array_v<std::remove_reference_t<T>>)
+        {
+            return static_cast<std::decay_t<T>>(arg);
+        }
+        else
+        {
+            return std::forward<T>(arg);
+        }
+    }
+
+    // How to turn the arguments of one argument-type signature into the parameters of a member
+    // function: for each one, either the argument itself, or the result of a Converter.
+    struct CallPlan
+    {
+        const void*            key {nullptr};
+        std::vector<Converter> steps;
+        const CallPlan*        next {nullptr};
+    };
+
+    // The plans built so far for a member function, shared by its copies. Readers do not lock; a
+    // new plan is pushed to the front.
+    class CallPlanCache
+    {
+    public:
+        CallPlanCache() = default;
+
+        CallPlanCache(const CallPlanCache&)            = delete;
+        CallPlanCache& operator=(const CallPlanCache&) = delete;
+
+        ~CallPlanCache();
+
+        // nullptr if there is no plan for `key` yet.
+        const CallPlan* Find(const void* key) const
+        {
+            for (const CallPlan* plan = m_head.load(std::memory_order_acquire); plan != nullptr; plan = plan->next)
+            {
+                if (plan->key == key)
+                {
+                    return plan;
+                }
+            }
+            return nullptr;
+        }
+
+        const CallPlan* Insert(std::unique_ptr<CallPlan> plan);
+
+        std::size_t size() const
+        {
+            std::size_t n = 0;
+            for (const CallPlan* plan = m_head.load(std::memory_order_acquire); plan != nullptr; plan = plan->next)
+            {
+                n++;
+            }
+            return n;
+        }
+
+    private:
+        std::atomic<const CallPlan*> m_head {nullptr};
+    };
+
+    // Identifies an argument-type signature by the address of its instance.
+    template<typename... Args>
+    inline constexpr char kCallKey = 0;
+
+    // A member function pointer, stored as bytes so that a MemberFunction needs no template
+    // parameters. The Itanium ABI makes them two words; MSVC may need more.
+    struct MethodPointer
+    {
+        alignas(void*) unsigned char bytes[4 * sizeof(void*)];
     };
 
+    // Calls the member function in `method` on `obj`. `args[i]` points to an object of the i-th
+    // parameter type without references and const; by-value parameters are copied from it, `T&&`
+    // ones moved.
+    using Thunk = Value (*)(const MethodPointer& method, void* obj, void** args);
+
+    template<typename Arg>
+    decltype(auto) ArgFrom(void* arg)
+    {
+        using Raw = std::remove_cv_t<std::remove_reference_t<Arg>>;
+        if constexpr (std::is_rvalue_reference_v<Arg>)
+        {
+            return std::move(*static_cast<Raw*>(arg));
+        }
+        else
+        {
+            return *static_cast<Raw*>(arg);
+        }
+    }
+
+    template<typename Func, typename Obj, typename R, typename... Args, std::size_t... Is>
+    Value CallMethod(const MethodPointer& method, void* obj, void** args, std::index_sequence<Is...>)
+    {
+        Func func;
+        std::memcpy(&func, method.bytes, sizeof(Func));
+        if constexpr (std::is_void_v<R>)
+        {
+            (static_cast<Obj*>(obj)->*func)(ArgFrom<Args>(args[Is])...);
+            return Value {};
+        }
+        else
+        {
+            return Value {(static_cast<Obj*>(obj)->*func)(ArgFrom<Args>(args[Is])...)};
+        }
+    }
+
+    template<typename Func, typename Obj, typename R, typename... Args>
+    Value MethodThunk(const MethodPointer& method, void* obj, void** args)
+    {
+        return CallMethod<Func, Obj, R, Args...>(method, obj, args, std::index_sequence_for<Args...> {});
+    }
+
     class MemberFunction
     {
     public:
@@ -60,84 +265,97 @@ namespace reflect
         template<typename C, typename R, typename... Args>
         explicit MemberFunction(R (C::*func)(Args...))
         {
-            m_function = [this, func](std::any obj_args) -> std::any {
-                auto& warpped_args = *std::any_cast<std::array<ArgWrap, sizeof...(Args) + 1>*>(obj_args);
-                auto  tuple_args   = UnwarpAsTuple<C&, Args...>(warpped_args);
-                return std::apply(func, tuple_args);
-            };
-            m_args_number = sizeof...(Args);
-        }
-
-        template<typename C, typename... Args>
-        explicit MemberFunction(void (C::*func)(Args...))
-        {
-            m_function = [this, func](std::any obj_args) -> std::any {
-                auto& warpped_args = *std::any_cast<std::array<ArgWrap, sizeof...(Args) + 1>*>(obj_args);
-                auto  tuple_args   = UnwarpAsTuple<C&, Args...>(warpped_args);
-                std::apply(func, tuple_args);
-                return std::any {};
-            };
-            m_args_number = sizeof...(Args);
+            Init<C, R, Args...>(func);
         }
 
         template<typename C, typename R, typename... Args>
         explicit MemberFunction(R (C::*func)(Args...) const)
         {
-            m_function = [this, func](std::any obj_args) -> std::any {
-                auto& warpped_args = *std::any_cast<std::array<ArgWrap, sizeof...(Args) + 1>*>(obj_args);
-                auto  tuple_args   = UnwarpAsTuple<const C&, Args...>(warpped_args);
-                return std::apply(func, tuple_args);
-            };
-            m_is_const    = true;
-            m_args_number = sizeof...(Args);
+            Init<const C, R, Args...>(func);
         }
 
+        const std::string& name() const { return m_name; }
+
+        bool is_const() const { return m_is_const; }
+
+        // The number of argument-type signatures this function, or a copy of it, has been called with.
+        std::size_t num_plans() const { return m_plans != nullptr ? m_plans->size() : 0; }
+
+        // Arguments whose types differ from the parameter types are converted through the
+        // ConversionRegistry. The first call with given argument types works out the conversions
+        // and caches them; later calls only replay them.
         template<typename C, typename... Args>
-        explicit MemberFunction(void (C::*func)(Args...) const)
+        Value Invoke(C& c, Args&&... args)
         {
-            m_function = [this, func](std::any obj_args) -> std::any {
-                auto& warpped_args = *std::any_cast<std::array<ArgWrap, sizeof...(Args) + 1>*>(obj_args);
-                auto  tuple_args   = UnwarpAsTuple<const C&, Args...>(warpped_args);
-                std::apply(func, tuple_args);
-                return std::any {};
-            };
-            m_is_const    = true;
-            m_args_number = sizeof...(Args);
+            return InvokeDecayed(c, DecayArray(std::forward<Args>(args))...);
         }
 
-        const std::string& name() const { return m_name; }
+    private:
+        friend class RawTypeDescriptorBuilder;
 
-        bool is_const() const { return m_is_const; }
+        template<typename Obj, typename R, typename... Args, typename Func>
+        void Init(Func func)
+        {
+            static_assert(sizeof(Func) <= sizeof(MethodPointer::bytes), "member function pointer too big");
+            std::memcpy(m_method.bytes, &func, sizeof(Func));
+            m_thunk       = &MethodThunk<Func, Obj, R, Args...>;
+            m_class_type  = GetTypeId<std::remove_const_t<Obj>>();
+            m_params      = kParamTypes<Args...>.data();
+            m_plans       = std::make_shared<CallPlanCache>();
+            m_is_const    = std::is_const_v<Obj>;
+            m_args_number = sizeof...(Args);
+        }
 
         template<typename C, typename... Args>
-        std::any Invoke(C& c, Args&&... args)
+        Value InvokeDecayed(C& c, Args&&... args)
         {
             if (m_args_number != sizeof...(Args))
             {
                 throw std::runtime_error("Mismatching number of args!");
             }
+            if (m_class_type != GetTypeId<std::remove_const_t<C>>() || (std::is_const_v<C> && !m_is_const))
+            {
+                throw BadValueCast {};
+            }
 
-            if (m_is_const)
+            const CallPlan* plan = m_plans->Find(&kCallKey<Args...>);
+            if (plan == nullptr)
             {
-                std::array<ArgWrap, sizeof...(Args) + 1> args_arr = {ArgWrap {c},
-                                                                     ArgWrap {std::forward<Args>(args)}...};
-                return m_function(&args_arr);
+                plan = m_plans->Insert(BuildPlan(&kCallKey<Args...>, kArgTypes<Args...>.data()));
             }
-            else
+
+            constexpr std::size_t kSlots        = sizeof...(Args) + 1;
+            void*                 obj           = const_cast<void*>(static_cast<const void*>(std::addressof(c)));
+            void*                 given[kSlots] = {ArgAddress(args)..., nullptr};
+            void*                 argv[kSlots]  = {};
+            Value                 converted[kSlots];
+            for (std::size_t i = 0; i < sizeof...(Args); i++)
             {
-                std::array<ArgWrap, sizeof...(Args) + 1> args_arr = {ArgWrap {c},
-                                                                     ArgWrap {std::forward<Args>(args)}...};
-                return m_function(&args_arr);
+                const Converter& step = plan->steps[i];
+                if (step)
+                {
+                    step(given[i], converted[i]);
+                    argv[i] = converted[i].data();
+                }
+                else
+                {
+                    argv[i] = given[i];
+                }
             }
+            return m_thunk(m_method, obj, argv);
         }
 
-    private:
-        friend class RawTypeDescriptorBuilder;
-
-        std::string                       m_name;
-        std::function<std::any(std::any)> m_function {nullptr};
-        bool                              m_is_const {false};
-        int                               m_args_number {0};
+        // Throws std::runtime_error if an argument cannot be passed.
+        std::unique_ptr<CallPlan> BuildPlan(const void* key, const ArgType* args) const;
+
+        std::string                    m_name;
+        MethodPointer                  m_method {};
+        Thunk                          m_thunk {nullptr};
+        TypeId                         m_class_type;
+        const ParamType*               m_params {nullptr};
+        std::shared_ptr<CallPlanCache> m_plans;
+        bool                           m_is_const {false};
+        int                            m_args_number {0};
     };
 
     class TypeDescriptor
@@ -59,7 +59,7 @@ void TestMemberFunction()
     MemberFunction foo_concat {&Foo::Concat};
     // foo_concat.Invoke(f, std::cref(hello_s), world_s);
     auto res = foo_concat.Invoke(f, std::cref(hello_s), std::cref(world_s));
-    std::cout << "Concat got: " << std::any_cast<std::string>(res) << std::endl;
+    std::cout << "Concat got: " << reflect::ValueCast<std::string>(res) << std::endl;
 
     std::cout << "<<< TestMemberFunction OK\n" << std::endl;
 }
@@ -115,7 +115,7 @@ void TestFoo()
     // Test member functions
     auto foo_make_float_ptr = foo_t.GetMemberFunc("MakeFloatPtr");
     auto res                = foo_make_float_ptr.Invoke(f, 123.4f);
-    auto float_sptr         = std::any_cast<std::shared_ptr<float>>(res);
+    auto float_sptr         = reflect::ValueCast<std::shared_ptr<float>>(res);
     std::cout << "MakeFloatPtr res: " << *float_sptr << std::endl;
 
     std::string hello_s {"hello"};
@@ -134,7 +134,7 @@ void TestFoo()
     foo_concat.Invoke(f, hello_s, world_s);
     res = foo_concat.Invoke(f, hello_s, hello_s);
     // res = foo_concat.Invoke(f, hello_s, hello_s); // Crash, parameter cast to null
-    std::cout << "Concat got: " << std::any_cast<std::string>(res) << std::endl;
+    std::cout << "Concat got: " << reflect::ValueCast<std::string>(res) << std::endl;
     std::cout << std::endl;
 
     std::cout << "<<< TestFoo OK\n" << std::endl;
@@ -2,7 +2,6 @@
 
 #include "unsafe_any.hpp"
 
-#include <any>
 #include <functional>
 #include <iostream>
 #include <memory>
@@ -21,12 +20,12 @@ namespace reflect
         template<typename C, typename T>
         MemberVariable(T C::*var)
         {
-            getter_ = [var](std::any obj) -> std::any { return std::any_cast<const C*>(obj)->*var; };
-            setter_ = [var](std::any obj, std::any val) {
+            getter_ = [var](Value obj) -> Value { return ValueCast<const C*>(obj)->*var; };
+            setter_ = [var](Value obj, Value val) {
                 // Syntax: https://stackoverflow.com/a/670744/12003165
                 // `obj.*member_var`
-                auto* self = std::any_cast<C*>(obj);
-                self->*var = std::any_cast<T>(val);
+                auto* self = ValueCast<C*>(obj);
+                self->*var = ValueCast<T>(val);
             };
         }
 
@@ -35,7 +34,7 @@ namespace reflect
         template<typename T, typename C>
         T GetValue(const C& c) const
         {
-            return std::any_cast<T>(getter_(&c));
+            return ValueCast<T>(getter_(&c));
         }
 
         template<typename C, typename T>
@@ -47,9 +46,9 @@ namespace reflect
     private:
         friend class RawTypeDescriptorBuilder;
 
-        std::string                             m_name;
-        std::function<std::any(std::any)>       getter_ {nullptr};
-        std::function<void(std::any, std::any)> setter_ {nullptr};
+        std::string                       m_name;
+        std::function<Value(Value)>       getter_ {nullptr};
+        std::function<void(Value, Value)> setter_ {nullptr};
     };
 
     class MemberFunction
@@ -60,8 +59,8 @@ namespace reflect
         template<typename C, typename R, typename... Args>
         explicit MemberFunction(R (C::*func)(Args...))
         {
-            m_function = [this, func](std::any obj_args) -> std::any {
-                auto& warpped_args = *std::any_cast<std::array<UnsafeAny, sizeof...(Args) + 1>*>(obj_args);
+            m_function = [this, func](Value obj_args) -> Value {
+                auto& warpped_args = *ValueCast<std::array<UnsafeAny, sizeof...(Args) + 1>*>(obj_args);
                 auto  tuple_args   = UnwarpAsTuple<C&, Args...>(warpped_args);
                 return std::apply(func, tuple_args);
             };
@@ -71,11 +70,11 @@ namespace reflect
         template<typename C, typename... Args>
         explicit MemberFunction(void (C::*func)(Args...))
         {
-            m_function = [this, func](std::any obj_args) -> std::any {
-                auto& warpped_args = *std::any_cast<std::array<UnsafeAny, sizeof...(Args) + 1>*>(obj_args);
+            m_function = [this, func](Value obj_args) -> Value {
+                auto& warpped_args = *ValueCast<std::array<UnsafeAny, sizeof...(Args) + 1>*>(obj_args);
                 auto  tuple_args   = UnwarpAsTuple<C&, Args...>(warpped_args);
                 std::apply(func, tuple_args);
-                return std::any {};
+                return Value {};
             };
             m_args_number = sizeof...(Args);
         }
@@ -83,8 +82,8 @@ namespace reflect
         template<typename C, typename R, typename... Args>
         explicit MemberFunction(R (C::*func)(Args...) const)
         {
-            m_function = [this, func](std::any obj_args) -> std::any {
-                auto& warpped_args = *std::any_cast<std::array<UnsafeAny, sizeof...(Args) + 1>*>(obj_args);
+            m_function = [this, func](Value obj_args) -> Value {
+                auto& warpped_args = *ValueCast<std::array<UnsafeAny, sizeof...(Args) + 1>*>(obj_args);
                 auto  tuple_args   = UnwarpAsTuple<const C&, Args...>(warpped_args);
                 return std::apply(func, tuple_args);
             };
@@ -95,11 +94,11 @@ namespace reflect
         template<typename C, typename... Args>
         explicit MemberFunction(void (C::*func)(Args...) const)
         {
-            m_function = [this, func](std::any obj_args) -> std::any {
-                auto& warpped_args = *std::any_cast<std::array<UnsafeAny, sizeof...(Args) + 1>*>(obj_args);
+            m_function = [this, func](Value obj_args) -> Value {
+                auto& warpped_args = *ValueCast<std::array<UnsafeAny, sizeof...(Args) + 1>*>(obj_args);
                 auto  tuple_args   = UnwarpAsTuple<const C&, Args...>(warpped_args);
                 std::apply(func, tuple_args);
-                return std::any {};
+                return Value {};
             };
             m_is_const    = true;
             m_args_number = sizeof...(Args);
@@ -110,7 +109,7 @@ namespace reflect
         bool is_const() const { return m_is_const; }
 
         template<typename C, typename... Args>
-        std::any Invoke(C& c, Args&&... args)
+        Value Invoke(C& c, Args&&... args)
         {
             if (m_args_number != sizeof...(Args))
             {
@@ -134,10 +133,10 @@ namespace reflect
     private:
         friend class RawTypeDescriptorBuilder;
 
-        std::string                       m_name;
-        std::function<std::any(std::any)> m_function {nullptr};
-        bool                              m_is_const {false};
-        int                               m_args_number {0};
+        std::string                 m_name;
+        std::function<Value(Value)> m_function {nullptr};
+        bool                        m_is_const {false};
+        int                         m_args_number {0};
     };
 
     class TypeDescriptor
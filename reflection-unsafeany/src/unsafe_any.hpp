@@ -1,4 +1,5 @@
-#include <any>
+#include "value.hpp"
+
 #include <array>
 #include <functional>
 #include <iostream>
@@ -9,41 +10,37 @@
 namespace reflect
 {
 
+    // An argument of MemberFunction::Invoke. Lvalues are referred to; rvalues are moved into a Value,
+    // which holds small arguments inline, so wrapping does not allocate for them and the value is
+    // destroyed as its real type.
     class UnsafeAny
     {
     public:
-        template<typename InputClass>
+        template<typename InputClass,
+                 typename = std::enable_if_t<!std::is_same_v<std::decay_t<InputClass>, UnsafeAny>>>
         UnsafeAny(InputClass&& val)
         {
-            m_ref_type = std::is_reference_v<InputClass>;
-            if (m_ref_type == 1)
+            if constexpr (std::is_reference_v<InputClass>)
             {
-                m_storage = &val;
+                m_ref = const_cast<void*>(static_cast<const void*>(&val));
             }
             else
             {
-                m_storage = new std::decay_t<InputClass>(val);
-            }
-        }
-
-        ~UnsafeAny()
-        {
-            if (!m_ref_type)
-            {
-                delete m_storage;
+                m_value.Emplace<std::decay_t<InputClass>>(std::move(val));
             }
         }
 
+        // Unchecked: `OutputClass` must be the type that was wrapped, up to references and const.
         template<typename OutputClass>
         OutputClass Cast()
         {
             using RawTptr = std::decay_t<OutputClass>*;
-            return *static_cast<RawTptr>(m_storage);
+            return *static_cast<RawTptr>(m_ref != nullptr ? m_ref : m_value.data());
         }
 
     private:
-        void* m_storage {};
-        int   m_ref_type {0};
+        void* m_ref {nullptr};
+        Value m_value;
     };
 
     template<typename... Args, size_t N, size_t... Is>
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "type_id.hpp"
+#include "value.hpp"
+
+namespace reflect
+{
+    namespace details
+    {
+
+        // Binary encoding of a member variable that is not copied as raw bytes. Both work on the
+        // member itself, not on the object.
+        struct FieldCodec
+        {
+            void (*write)(const void* field, std::vector<uint8_t>& out) {nullptr};
+            // Returns the number of bytes read. Throws std::runtime_error if `size` is too short.
+            std::size_t (*read)(void* field, const uint8_t* data, std::size_t size) {nullptr};
+        };
+
+        // Members of registered types, looked up by id when the plan runs.
+        void        WriteObject(TypeId type, const void* obj, std::vector<uint8_t>& out);
+        std::size_t ReadObject(TypeId type, void* obj, const uint8_t* data, std::size_t size);
+
+        // Throws std::runtime_error if fewer than `needed` bytes are left.
+        inline void CheckAvailable(std::size_t needed, std::size_t size)
+        {
+            if (needed > size)
+            {
+                throw std::runtime_error("reflect: truncated input");
+            }
+        }
+
+        // Members that are copied as raw bytes. Pointers are trivially copyable too, but their
+        // values mean nothing after a round trip.
+        template<typename T>
+        constexpr bool kIsRawField =
+            std::is_trivially_copyable_v<T> && !std::is_pointer_v<T> && !std::is_member_pointer_v<T>;
+
+        template<typename T>
+        struct IsVector : std::false_type
+        {};
+
+        template<typename T, typename A>
+        struct IsVector<std::vector<T, A>> : std::true_type
+        {};
+
+        inline void WriteSize(uint64_t n, std::vector<uint8_t>& out)
+        {
+            const std::size_t pos = out.size();
+            out.resize(pos + sizeof(n));
+            std::memcpy(out.data() + pos, &n, sizeof(n));
+        }
+
+        inline uint64_t ReadSize(const uint8_t* data, std::size_t size)
+        {
+            uint64_t n;
+            CheckAvailable(sizeof(n), size);
+            std::memcpy(&n, data, sizeof(n));
+            return n;
+        }
+
+        // A length, then the elements as raw bytes.
+        template<typename T>
+        void WriteSequence(const void* field, std::vector<uint8_t>& out)
+        {
+            const auto&       seq   = *static_cast<const T*>(field);
+            const std::size_t bytes = seq.size() * sizeof(typename T::value_type);
+            WriteSize(seq.size(), out);
+            const std::size_t pos = out.size();
+            out.resize(pos + bytes);
+            if (bytes != 0)
+            {
+                std::memcpy(out.data() + pos, seq.data(), bytes);
+            }
+        }
+
+        template<typename T>
+        std::size_t ReadSequence(void* field, const uint8_t* data, std::size_t size)
+        {
+            auto&          seq = *static_cast<T*>(field);
+            const uint64_t n   = ReadSize(data, size);
+            // Checked by division, so that a corrupt length cannot overflow.
+            if (n > (size - sizeof(n)) / sizeof(typename T::value_type))
+            {
+                throw std::runtime_error("reflect: truncated input");
+            }
+            const std::size_t bytes = n * sizeof(typename T::value_type);
+            seq.resize(n);
+            if (bytes != 0)
+            {
+                std::memcpy(&seq[0], data + sizeof(n), bytes);
+            }
+            return sizeof(n) + bytes;
+        }
+
+        template<typename T>
+        void WriteNested(const void* field, std::vector<uint8_t>& out)
+        {
+            WriteObject(GetTypeId<T>(), field, out);
+        }
+
+        template<typename T>
+        std::size_t ReadNested(void* field, const uint8_t* data, std::size_t size)
+        {
+            return ReadObject(GetTypeId<T>(), field, data, size);
+        }
+
+        // Empty for raw fields, which the plan copies directly, and for members that cannot be
+        // serialized.
+        template<typename T>
+        constexpr FieldCodec MakeFieldCodec()
+        {
+            if constexpr (std::is_same_v<T, std::string>)
+            {
+                return FieldCodec {&WriteSequence<T>, &ReadSequence<T>};
+            }
+            else if constexpr (IsVector<T>::value)
+            {
+                if constexpr (kIsRawField<typename T::value_type> && !std::is_same_v<typename T::value_type, bool>)
+                {
+                    return FieldCodec {&WriteSequence<T>, &ReadSequence<T>};
+                }
+                else
+                {
+                    return FieldCodec {};
+                }
+            }
+            else if constexpr (std::is_class_v<T> && !kIsRawField<T>)
+            {
+                // Serialized through its own registration, if it has one.
+                return FieldCodec {&WriteNested<T>, &ReadNested<T>};
+            }
+            else
+            {
+                return FieldCodec {};
+            }
+        }
+
+        template<typename T>
+        struct IsEqualityComparable
+        {
+        private:
+            template<typename U>
+            static auto Test(int) -> decltype(std::declval<const U&>() == std::declval<const U&>(), std::true_type {});
+
+            template<typename U>
+            static std::false_type Test(...);
+
+        public:
+            static constexpr bool value = decltype(Test<T>(0))::value;
+        };
+
+        // std::vector declares == and copy assignment whatever its elements; their definitions
+        // would not compile.
+        template<typename T, typename A>
+        struct IsEqualityComparable<std::vector<T, A>> : IsEqualityComparable<T>
+        {};
+
+        template<typename T>
+        constexpr bool kIsCopyAssignable = std::is_copy_assignable_v<T>;
+
+        template<typename T, typename A>
+        constexpr bool kIsCopyAssignable<std::vector<T, A>> = kIsCopyAssignable<T>;
+
+        template<typename T>
+        Value GetField(const void* field)
+        {
+            return *static_cast<const T*>(field);
+        }
+
+        template<typename T>
+        void SetField(void* field, Value&& val)
+        {
+            *static_cast<T*>(field) = ValueCast<T>(std::move(val));
+        }
+
+        template<typename T>
+        void CopyField(void* to, const void* from)
+        {
+            *static_cast<T*>(to) = *static_cast<const T*>(from);
+        }
+
+        template<typename T>
+        bool EqualField(const void* a, const void* b)
+        {
+            return static_cast<bool>(*static_cast<const T*>(a) == *static_cast<const T*>(b));
+        }
+
+        // Everything a type-erased member variable does with its value, given the address of the
+        // member. One table per member type, shared by all members of that type.
+        struct FieldOps
+        {
+            TypeId      type;
+            std::size_t size {0};
+            // Copied and serialized as raw bytes.
+            bool is_raw {false};
+            // Compared by their bytes: scalars that are equal exactly if their bytes are, which
+            // excludes floating point, and classes without padding that have no == of their own.
+            bool is_bitwise_comparable {false};
+            Value (*get)(const void* field) {nullptr};
+            void (*set)(void* field, Value&& val) {nullptr};
+            // Null if the type has no copy assignment and no ==, respectively.
+            void (*copy)(void* to, const void* from) {nullptr};
+            bool (*equal)(const void* a, const void* b) {nullptr};
+            FieldCodec codec;
+        };
+
+        template<typename T>
+        constexpr FieldOps MakeFieldOps()
+        {
+            FieldOps ops;
+            ops.type                  = GetTypeId<T>();
+            ops.size                  = sizeof(T);
+            ops.is_raw                = kIsRawField<T>;
+            ops.is_bitwise_comparable = std::has_unique_object_representations_v<T> &&
+                                        (std::is_scalar_v<T> || !IsEqualityComparable<T>::value);
+            ops.get                   = &GetField<T>;
+            ops.set                   = &SetField<T>;
+            if constexpr (kIsCopyAssignable<T>)
+            {
+                ops.copy = &CopyField<T>;
+            }
+            if constexpr (IsEqualityComparable<T>::value)
+            {
+                ops.equal = &EqualField<T>;
+            }
+            ops.codec = MakeFieldCodec<T>();
+            return ops;
+        }
+
+        template<typename T>
+        inline constexpr FieldOps kFieldOps = MakeFieldOps<T>();
+
+        // Where a member variable is within an object of its class: `offset` bytes in for
+        // standard-layout classes, and otherwise wherever its `T C::*` leads, since the offset of
+        // a member of any other class cannot be taken without an object.
+        struct MemberLocation
+        {
+            std::size_t offset {0};
+            // Null for standard-layout classes.
+            void* (*resolve)(const unsigned char* member_ptr, void* obj) {nullptr};
+            // The bytes of the `T C::*`, large enough for every ABI's data member pointers.
+            unsigned char member_ptr[2 * sizeof(void*)] {};
+
+            void* In(void* obj) const
+            {
+                return resolve != nullptr ? resolve(member_ptr, obj) : static_cast<unsigned char*>(obj) + offset;
+            }
+
+            const void* In(const void* obj) const { return In(const_cast<void*>(obj)); }
+        };
+
+        template<typename C, typename T>
+        void* ResolveMember(const unsigned char* member_ptr, void* obj)
+        {
+            T C::*var;
+            std::memcpy(&var, member_ptr, sizeof(var));
+            return std::addressof(static_cast<C*>(obj)->*var);
+        }
+
+        // One step of a plan over the member variables of an object: `size` bytes at `location`,
+        // possibly spanning several adjacent members, or one member through `ops` if `size` is 0.
+        struct FieldStep
+        {
+            MemberLocation  location;
+            std::size_t     size {0};
+            const FieldOps* ops {nullptr};
+        };
+
+        // The steps of an operation on all member variables, in registration order. Empty with a
+        // non-empty `unsupported_member` if one of them does not support the operation.
+        struct FieldPlan
+        {
+            std::vector<FieldStep> steps;
+            std::string            unsupported_member;
+        };
+
+    } // namespace details
+} // namespace reflect
@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 #include "reflect.hpp"
+#include "serializer.hpp"
 
 class Foo {
  public:
@@ -40,6 +43,16 @@ class Foo {
   int x_{0};
 };
 
+// Registered without running any code at startup; built on first lookup
+struct Point {
+  float x{0.0f};
+  float y{0.0f};
+};
+
+static constexpr std::tuple kPointMembers{reflect::Member{"x", &Point::x},
+                                          reflect::Member{"y", &Point::y}};
+const reflect::StaticClass<Point> kPointClass{"Point", kPointMembers};
+
 void TestMemberFunction() {
   std::cout << ">>> TestMemberFunction" << std::endl;
   using namespace reflect::details;
@@ -51,14 +64,12 @@ void TestMemberFunction() {
   foo_pass_by_val.Invoke(f, hello_s);
 
   MemberFunction foo_pass_by_cref{&Foo::PassByConstRef};
-  // foo_pass_by_cref.Invoke(f, hello_s);  // Crash, value
-  // foo_pass_by_cref.Invoke(f, std::ref(hello_s));  // Crash, non-const ref
-  foo_pass_by_cref.Invoke(f, std::cref(hello_s));  // OK: const ref
+  // Values, references, std::ref and std::cref all bind to `const T &`
+  foo_pass_by_cref.Invoke(f, std::cref(hello_s));
 
   MemberFunction foo_concat{&Foo::Concat};
-  // foo_concat.Invoke(f, std::cref(hello_s), world_s);
-  auto res = foo_concat.Invoke(f, std::cref(hello_s), std::cref(world_s));
-  std::cout << "Concat got: " << std::any_cast<std::string>(res) << std::endl;
+  auto res = foo_concat.Invoke(f, hello_s, std::cref(world_s));
+  std::cout << "Concat got: " << reflect::ValueCast<std::string>(res) << std::endl;
 
   std::cout << "<<< TestMemberFunction OK\n" << std::endl;
 }
@@ -88,7 +99,13 @@ void TestFoo() {
   std::cout << ">>> TestFoo\n" << std::endl;
 
   Foo::MakeReflectable();
-  auto foo_t = reflect::GetByName("Foo");
+  // Lookups are lock-free from here on
+  reflect::FreezeRegistry();
+  const auto &foo_t = reflect::GetByName("Foo");
+  std::cout << "Bar registered=" << (reflect::FindByName("Bar") != nullptr)
+            << std::endl;
+  std::cout << "Point members="
+            << reflect::GetByType<Point>().member_vars().size() << std::endl;
   for (const auto &mv : foo_t.member_vars()) {
     std::cout << "member var: " << mv.name() << std::endl;
   }
@@ -101,38 +118,141 @@ void TestFoo() {
 
   Foo f;
   // Test member variables
-  auto name_var = foo_t.GetMemberVar("name");
+  const auto &name_var = foo_t.GetMemberVar("name");
   name_var.SetValue(f, std::string{"taichi"});
   std::cout << "f.name=" << f.name << std::endl;
-  auto x_var = foo_t.GetMemberVar("x_");
+  const auto &x_var = foo_t.GetMemberVar("x_");
   x_var.SetValue(f, 42);
   std::cout << "f.x=" << f.x() << std::endl;
+  // Looked up once, then as cheap as `f.x_`
+  auto x_field = foo_t.GetField<Foo, int>("x_");
+  x_field.Set(f, x_field.Get(f) + 1);
+  std::cout << "f.x=" << f.x() << std::endl;
+  std::cout << "x_ as float valid=" << foo_t.GetField<Foo, float>("x_").valid()
+            << std::endl;
+  // Round trip through the registered member variables
+  std::vector<uint8_t> bytes;
+  reflect::Serialize(f, bytes);
+  Foo g;
+  reflect::Deserialize(g, bytes.data(), bytes.size());
+  std::cout << "g.name=" << g.name << ", g.x=" << g.x() << std::endl;
+  // Member-wise, from the registered member variables
+  Foo h;
+  foo_t.CopyMembers(&h, &f);
+  std::cout << "h equals f=" << foo_t.Equal(&h, &f) << std::endl;
   std::cout << std::endl;
 
   // Test member functions
-  auto foo_make_float_ptr = foo_t.GetMemberFunc("MakeFloatPtr");
+  const auto &foo_make_float_ptr = foo_t.GetMemberFunc("MakeFloatPtr");
   auto res = foo_make_float_ptr.Invoke(f, 123.4f);
-  auto float_sptr = std::any_cast<std::shared_ptr<float>>(res);
+  auto float_sptr = reflect::ValueCast<std::shared_ptr<float>>(res);
   std::cout << "MakeFloatPtr res: " << *float_sptr << std::endl;
 
   std::string hello_s{"hello"};
   std::string world_s{" world"};
 
-  auto foo_pass_by_val = foo_t.GetMemberFunc("PassByValue");
+  const auto &foo_pass_by_val = foo_t.GetMemberFunc("PassByValue");
   foo_pass_by_val.Invoke(f, hello_s);
 
-  auto foo_pass_by_cref = foo_t.GetMemberFunc("PassByConstRef");
-  // foo_pass_by_cref.Invoke(f, hello_s);  // Crash, value
-  // foo_pass_by_cref.Invoke(f, std::ref(hello_s));  // Crash, non-const ref
-  foo_pass_by_cref.Invoke(f, std::cref(hello_s));  // OK: const ref
+  const auto &foo_pass_by_cref = foo_t.GetMemberFunc("PassByConstRef");
+  foo_pass_by_cref.Invoke(f, hello_s);
 
-  auto foo_concat = foo_t.GetMemberFunc("Concat");
-  // foo_concat.Invoke(f, hello_s, world_s);
-  res = foo_concat.Invoke(f, std::cref(hello_s), std::cref(world_s));
-  std::cout << "Concat got: " << std::any_cast<std::string>(res) << std::endl;
+  const auto &foo_concat = foo_t.GetMemberFunc("Concat");
+  res = foo_concat.Invoke(f, hello_s, world_s);
+  std::cout << "Concat got: " << reflect::ValueCast<std::string>(res) << std::endl;
+  // Signature checked once, then a single indirect call per call
+  auto concat = foo_t.GetMethod<Foo, std::string, const std::string &,
+                                const std::string &>("Concat");
+  std::cout << "Concat got: " << concat(f, world_s, hello_s) << std::endl;
   std::cout << std::endl;
 
   std::cout << "<<< TestFoo OK\n" << std::endl;
 }
 
-int main() { TestFoo(); }
+void TestGatherScatter() {
+  std::cout << ">>> TestGatherScatter" << std::endl;
+  std::vector<Point> points(100);
+  for (std::size_t i = 0; i < points.size(); i++) {
+    points[i].x = static_cast<float>(i);
+    points[i].y = static_cast<float>(2 * i);
+  }
+  const auto &y_var = reflect::GetByType<Point>().GetMemberVar("y");
+
+  // One column out of an array of structs
+  std::vector<float> ys(points.size());
+  y_var.Gather(points.data(), points.size(), ys.data());
+  bool gathered = true;
+  for (std::size_t i = 0; i < points.size(); i++) {
+    gathered = gathered && ys[i] == points[i].y;
+  }
+  std::cout << "gather ok=" << gathered << std::endl;
+
+  for (auto &y : ys) {
+    y += 0.5f;
+  }
+  y_var.Scatter(points.data(), points.size(), ys.data());
+  bool scattered = true;
+  for (std::size_t i = 0; i < points.size(); i++) {
+    scattered = scattered && points[i].y == 2 * i + 0.5f &&
+                points[i].x == static_cast<float>(i);
+  }
+  std::cout << "scatter ok=" << scattered << std::endl;
+  std::cout << "<<< TestGatherScatter OK\n" << std::endl;
+}
+
+struct Counter {
+  void Add(int n) { total += n; }
+  void Take(std::string &&s) { last = std::move(s); }
+
+  int total{0};
+  std::string last;
+};
+
+void TestInvokeBatch() {
+  std::cout << ">>> TestInvokeBatch" << std::endl;
+  using namespace reflect::details;
+  MemberFunction add{&Counter::Add};
+  MemberFunction take{&Counter::Take};
+
+  std::vector<Counter> counters(1000);
+  add.InvokeBatch(counters.data(), counters.size(), 2);
+  // A `T &&` parameter gets its own copy of the argument on every call
+  take.InvokeBatch(counters.data(), counters.size(), std::string{"moved"});
+  std::cout << "batch ok="
+            << std::all_of(counters.begin(), counters.end(),
+                           [](const Counter &c) {
+                             return c.total == 2 && c.last == "moved";
+                           })
+            << std::endl;
+
+  // Counters inside bigger structs
+  struct Slot {
+    double weight{0.0};
+    Counter counter;
+  };
+  std::vector<Slot> slots(100);
+  add.InvokeBatchStrided(&slots[0].counter, slots.size(), sizeof(Slot), 3);
+  std::cout << "strided ok="
+            << std::all_of(slots.begin(), slots.end(),
+                           [](const Slot &s) {
+                             return s.counter.total == 3 && s.weight == 0.0;
+                           })
+            << std::endl;
+
+  reflect::ThreadPool pool{3};
+  add.InvokeBatch(pool, counters.data(), counters.size(), 5);
+  take.InvokeBatch(pool, counters.data(), counters.size(), std::string{"pooled"});
+  std::cout << "pool ok="
+            << std::all_of(counters.begin(), counters.end(),
+                           [](const Counter &c) {
+                             return c.total == 7 && c.last == "pooled";
+                           })
+            << std::endl;
+  std::cout << "<<< TestInvokeBatch OK\n" << std::endl;
+}
+
+int main() {
+  TestFoo();
+  TestGatherScatter();
+  TestInvokeBatch();
+}
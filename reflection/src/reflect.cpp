@@ -1,32 +1,342 @@
 #include "reflect.hpp"
 
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 
 namespace reflect
 {
     namespace details
     {
 
-        RawTypeDescriptorBuilder::RawTypeDescriptorBuilder(const std::string& name)
+        RawTypeDescriptorBuilder::RawTypeDescriptorBuilder(const std::string& name, TypeId type_id)
             : desc_(std::make_unique<TypeDescriptor>())
         {
-            desc_->m_name = name;
+            desc_->m_name    = name;
+            desc_->m_type_id = type_id;
         }
 
-        RawTypeDescriptorBuilder::~RawTypeDescriptorBuilder() { Registry::instance().Register(std::move(desc_)); }
+        RawTypeDescriptorBuilder::~RawTypeDescriptorBuilder()
+        {
+            // Moved-from and built builders have nothing to register.
+            if (desc_ != nullptr)
+            {
+                Registry::instance().Register(Build());
+            }
+        }
+
+        std::unique_ptr<TypeDescriptor> RawTypeDescriptorBuilder::Build()
+        {
+            desc_->BuildIndex();
+            desc_->BuildPlans();
+            return std::move(desc_);
+        }
+
+        StaticTypeEntry::StaticTypeEntry(std::string_view name,
+                                         TypeId           type_id,
+                                         const void*      members,
+                                         AddMembers       add_members)
+            : m_name(name)
+            , m_type_id(type_id)
+            , m_members(members)
+            , m_add_members(add_members)
+        {
+            // Entries of libraries loaded later may be linked concurrently.
+            std::atomic<StaticTypeEntry*>& list = head();
+            m_next                              = list.load(std::memory_order_relaxed);
+            while (!list.compare_exchange_weak(m_next, this, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        namespace
+        {
+            // Appends the member at `location` to `plan`, as bytes if `as_bytes`, which are merged
+            // with the last step if both are at known offsets and follow each other without padding.
+            void AddStep(FieldPlan& plan, const MemberLocation& location, const FieldOps& ops, bool as_bytes)
+            {
+                if (!as_bytes)
+                {
+                    plan.steps.push_back(FieldStep {location, 0, &ops});
+                    return;
+                }
+                if (!plan.steps.empty() && location.resolve == nullptr)
+                {
+                    FieldStep& last = plan.steps.back();
+                    if (last.size != 0 && last.location.resolve == nullptr &&
+                        last.location.offset + last.size == location.offset)
+                    {
+                        last.size += ops.size;
+                        return;
+                    }
+                }
+                plan.steps.push_back(FieldStep {location, ops.size, nullptr});
+            }
+
+            void MarkUnsupported(FieldPlan& plan, const std::string& member)
+            {
+                if (plan.unsupported_member.empty())
+                {
+                    plan.steps.clear();
+                    plan.unsupported_member = member;
+                }
+            }
+
+            void CheckSupported(const FieldPlan& plan, const std::string& type, const char* operation)
+            {
+                if (!plan.unsupported_member.empty())
+                {
+                    throw std::runtime_error("reflect: member `" + plan.unsupported_member + "` of `" + type +
+                                             "` cannot be " + operation);
+                }
+            }
+        } // namespace
+
+        bool MemberVariable::EqualAt(const void* a, const void* b) const
+        {
+            if (m_ops->is_bitwise_comparable)
+            {
+                return std::memcmp(FieldOf(a), FieldOf(b), m_ops->size) == 0;
+            }
+            if (m_ops->equal == nullptr)
+            {
+                throw std::runtime_error("reflect: member `" + m_name + "` cannot be compared");
+            }
+            return m_ops->equal(FieldOf(a), FieldOf(b));
+        }
+
+        void MemberVariable::CopyAt(void* to, const void* from) const
+        {
+            if (m_ops->copy == nullptr)
+            {
+                throw std::runtime_error("reflect: member `" + m_name + "` cannot be copied");
+            }
+            m_ops->copy(FieldOf(to), FieldOf(from));
+        }
+
+        bool TypeDescriptor::Equal(const void* a, const void* b) const
+        {
+            CheckSupported(m_compare_plan, m_name, "compared");
+            for (const auto& step : m_compare_plan.steps)
+            {
+                const void* lhs   = step.location.In(a);
+                const void* rhs   = step.location.In(b);
+                const bool  equal = step.size != 0 ? std::memcmp(lhs, rhs, step.size) == 0 : step.ops->equal(lhs, rhs);
+                if (!equal)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void TypeDescriptor::CopyMembers(void* to, const void* from) const
+        {
+            CheckSupported(m_copy_plan, m_name, "copied");
+            for (const auto& step : m_copy_plan.steps)
+            {
+                void*       dst = step.location.In(to);
+                const void* src = step.location.In(from);
+                if (step.size != 0)
+                {
+                    // memmove, since `to` and `from` may be the same object.
+                    std::memmove(dst, src, step.size);
+                }
+                else
+                {
+                    step.ops->copy(dst, src);
+                }
+            }
+        }
+
+        void TypeDescriptor::BuildPlans()
+        {
+            m_compare_plan = FieldPlan {};
+            m_copy_plan    = FieldPlan {};
+            m_serial_plan  = FieldPlan {};
+            for (const auto& mv : m_member_vars)
+            {
+                const FieldOps& ops = *mv.m_ops;
+                if (ops.is_bitwise_comparable || ops.equal != nullptr)
+                {
+                    AddStep(m_compare_plan, mv.m_location, ops, ops.is_bitwise_comparable);
+                }
+                else
+                {
+                    MarkUnsupported(m_compare_plan, mv.name());
+                }
+                if (ops.is_raw || ops.copy != nullptr)
+                {
+                    AddStep(m_copy_plan, mv.m_location, ops, ops.is_raw);
+                }
+                else
+                {
+                    MarkUnsupported(m_copy_plan, mv.name());
+                }
+                if (ops.is_raw || ops.codec.write != nullptr)
+                {
+                    AddStep(m_serial_plan, mv.m_location, ops, ops.is_raw);
+                }
+                else
+                {
+                    MarkUnsupported(m_serial_plan, mv.name());
+                }
+            }
+        }
 
-        TypeDescriptor* Registry::Find(const std::string& name) { return type_descs_.find(name)->second.get(); }
+        template<typename Key, typename Descs, typename Statics>
+        const TypeDescriptor* Registry::Find(const Key& key, Descs Snapshot::*descs, Statics Snapshot::*statics)
+        {
+            if (StaticTypeEntry::head().load(std::memory_order_acquire) != m_linked.load(std::memory_order_acquire))
+            {
+                LinkStaticTypes();
+            }
+            StaticTypeEntry* entry = nullptr;
+            {
+                const Snapshot*              snapshot = m_snapshot.load(std::memory_order_acquire);
+                std::unique_lock<std::mutex> lock;
+                if (snapshot == nullptr)
+                {
+                    lock     = std::unique_lock<std::mutex> {m_mutex};
+                    snapshot = &m_types;
+                }
+                else if (m_stale.load(std::memory_order_acquire))
+                {
+                    // The first lookup after late registrations publishes them all at once.
+                    lock = std::unique_lock<std::mutex> {m_mutex};
+                    if (m_stale.load(std::memory_order_relaxed))
+                    {
+                        Publish();
+                    }
+                    snapshot = m_snapshot.load(std::memory_order_relaxed);
+                }
+                auto it = (snapshot->*descs).find(key);
+                if (it != (snapshot->*descs).end())
+                {
+                    return it->second;
+                }
+                auto static_it = (snapshot->*statics).find(key);
+                if (static_it == (snapshot->*statics).end())
+                {
+                    return nullptr;
+                }
+                entry = static_it->second;
+            }
+            const TypeDescriptor* desc = entry->m_desc.load(std::memory_order_acquire);
+            return desc != nullptr ? desc : BuildStaticType(*entry);
+        }
+
+        const TypeDescriptor* Registry::Find(std::string_view name)
+        {
+            return Find(name, &Snapshot::names, &Snapshot::static_names);
+        }
+
+        const TypeDescriptor* Registry::Find(TypeId type_id)
+        {
+            return Find(type_id, &Snapshot::ids, &Snapshot::static_ids);
+        }
+
+        void Registry::LinkStaticTypes()
+        {
+            std::lock_guard<std::mutex> lock {m_mutex};
+            StaticTypeEntry*            head   = StaticTypeEntry::head().load(std::memory_order_acquire);
+            StaticTypeEntry*            linked = m_linked.load(std::memory_order_relaxed);
+            if (head == linked)
+            {
+                return;
+            }
+            // The list is newest first, and newer entries replace older ones with the same name.
+            std::vector<StaticTypeEntry*> entries;
+            for (StaticTypeEntry* entry = head; entry != linked; entry = entry->m_next)
+            {
+                entries.push_back(entry);
+            }
+            for (auto it = entries.rbegin(); it != entries.rend(); ++it)
+            {
+                m_types.static_names[(*it)->m_name]  = *it;
+                m_types.static_ids[(*it)->m_type_id] = *it;
+            }
+            if (frozen())
+            {
+                m_stale.store(true, std::memory_order_release);
+            }
+            // After that, so that lookups that see the new head also see the entries.
+            m_linked.store(head, std::memory_order_release);
+        }
+
+        const TypeDescriptor* Registry::BuildStaticType(StaticTypeEntry& entry)
+        {
+            // Built without the lock, which a concurrent build of the same type may race to.
+            RawTypeDescriptorBuilder builder {std::string {entry.m_name}, entry.m_type_id};
+            entry.m_add_members(entry.m_members, builder);
+            std::unique_ptr<TypeDescriptor> built = builder.Build();
+
+            std::lock_guard<std::mutex> lock {m_mutex};
+            const TypeDescriptor*       desc = entry.m_desc.load(std::memory_order_relaxed);
+            if (desc == nullptr)
+            {
+                desc = built.get();
+                m_descs.push_back(std::move(built));
+                entry.m_desc.store(desc, std::memory_order_release);
+            }
+            return desc;
+        }
 
         void Registry::Register(std::unique_ptr<TypeDescriptor> desc)
         {
-            auto name         = desc->name();
-            type_descs_[name] = std::move(desc);
+            std::lock_guard<std::mutex> lock {m_mutex};
+            auto                        it = m_types.names.find(desc->name());
+            if (it != m_types.names.end())
+            {
+                // The id may have been taken over by a type registered under another name since.
+                auto id_it = m_types.ids.find(it->second->type_id());
+                if (id_it != m_types.ids.end() && id_it->second == it->second)
+                {
+                    m_types.ids.erase(id_it);
+                }
+                m_types.names.erase(it);
+            }
+            m_types.names[desc->name()]  = desc.get();
+            m_types.ids[desc->type_id()] = desc.get();
+            m_descs.push_back(std::move(desc));
+            if (frozen())
+            {
+                m_stale.store(true, std::memory_order_release);
+            }
+        }
+
+        void Registry::Freeze()
+        {
+            std::lock_guard<std::mutex> lock {m_mutex};
+            if (!frozen() || m_stale.load(std::memory_order_relaxed))
+            {
+                Publish();
+            }
+        }
+
+        void Registry::Publish()
+        {
+            m_snapshots.push_back(std::make_unique<Snapshot>(m_types));
+            m_snapshot.store(m_snapshots.back().get(), std::memory_order_release);
+            m_stale.store(false, std::memory_order_release);
         }
 
         void Registry::Clear()
         {
-            decltype(type_descs_) tmp;
-            tmp.swap(type_descs_);
+            std::lock_guard<std::mutex> lock {m_mutex};
+            m_snapshot.store(nullptr, std::memory_order_release);
+            m_stale.store(false, std::memory_order_relaxed);
+            m_snapshots.clear();
+            m_types = Snapshot {};
+            m_descs.clear();
+            // Linked again, and built again, by the next lookups.
+            StaticTypeEntry* entry = m_linked.load(std::memory_order_relaxed);
+            while (entry != nullptr)
+            {
+                entry->m_desc.store(nullptr, std::memory_order_relaxed);
+                entry = entry->m_next;
+            }
+            m_linked.store(nullptr, std::memory_order_release);
         }
 
     } // namespace details
@@ -36,7 +346,13 @@ namespace reflect
         using namespace details;
     } // namespace
 
-    details::TypeDescriptor& GetByName(const std::string& name) { return *Registry::instance().Find(name); }
+    const details::TypeDescriptor& GetByName(std::string_view name)
+    {
+        const TypeDescriptor* desc = Registry::instance().Find(name);
+        return desc != nullptr ? *desc : TypeDescriptor::None();
+    }
+
+    void FreezeRegistry() { Registry::instance().Freeze(); }
 
     void ClearRegistry() { Registry::instance().Clear(); }
 
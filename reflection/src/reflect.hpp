@@ -3,19 +3,99 @@
 // https://github.com/rttrorg/rttr
 // https://preshing.com/20180116/a-primitive-reflection-system-in-cpp-part-1/
 
-#include <any>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
+
+#include "field_codec.hpp"
+#include "thread_pool.hpp"
+#include "type_id.hpp"
+#include "value.hpp"
+
 namespace reflect
 {
     namespace details
     {
 
+        // Typed access to the member `T C::*`. Get and Set are a plain member access, with no
+        // type erasure and no allocation; obtain a handle once and keep it.
+        template<typename C, typename T>
+        class FieldHandle
+        {
+        public:
+            FieldHandle() = default;
+
+            explicit FieldHandle(T C::*var)
+                : m_var(var)
+            {}
+
+            // False if the member was not found or has another type.
+            bool valid() const { return m_var != nullptr; }
+
+            explicit operator bool() const { return valid(); }
+
+            const T& Get(const C& c) const { return c.*m_var; }
+
+            T& Get(C& c) const { return c.*m_var; }
+
+            template<typename V>
+            void Set(C& c, V&& val) const
+            {
+                c.*m_var = std::forward<V>(val);
+            }
+
+            // Copies the member of `count` objects into `out`, e.g. to get a column of an array
+            // of structs. A load at a fixed offset and stride per object, which the compiler can
+            // unroll and vectorize.
+            void Gather(const C* objects, std::size_t count, T* out) const
+            {
+                const T C::*var = m_var;
+                for (std::size_t i = 0; i < count; i++)
+                {
+                    out[i] = objects[i].*var;
+                }
+            }
+
+            // The reverse of Gather: sets the member of `count` objects from `in`.
+            void Scatter(C* objects, std::size_t count, const T* in) const
+            {
+                T C::*var = m_var;
+                for (std::size_t i = 0; i < count; i++)
+                {
+                    objects[i].*var = in[i];
+                }
+            }
+
+        private:
+            T C::*m_var {nullptr};
+        };
+
+        // The offset of a member within its standard-layout class, as offsetof would give it. Only
+        // addresses are computed, relative to a suitably aligned address; no `C` is accessed.
+        template<typename C, typename T>
+        std::size_t MemberOffset(T C::*var)
+        {
+            static_assert(std::is_standard_layout_v<C>, "member offsets need a standard-layout class");
+            constexpr std::uintptr_t kBase = alignof(C) > 4096 ? alignof(C) : 4096;
+            const auto*              obj   = reinterpret_cast<const C*>(kBase);
+            return reinterpret_cast<std::uintptr_t>(&(obj->*var)) - kBase;
+        }
+
+        // A member variable as its location within the class and the FieldOps of its type, so that
+        // reading, writing, comparing and copying it needs no closure. Members of standard-layout
+        // classes are found by offset; those of other classes through the member pointer.
         class MemberVariable
         {
         public:
@@ -23,36 +103,386 @@ namespace reflect
 
             template<typename C, typename T>
             MemberVariable(T C::*var)
+                : m_class_type(GetTypeId<C>())
+                , m_ops(&kFieldOps<T>)
             {
-                getter_ = [var](std::any obj) -> std::any { return std::any_cast<const C*>(obj)->*var; };
-                setter_ = [var](std::any obj, std::any val) {
-                    // Syntax: https://stackoverflow.com/a/670744/12003165
-                    // `obj.*member_var`
-                    auto* self = std::any_cast<C*>(obj);
-                    self->*var = std::any_cast<T>(val);
-                };
+                static_assert(sizeof(var) <= sizeof(m_location.member_ptr),
+                              "unsupported member pointer representation");
+                std::memcpy(m_location.member_ptr, &var, sizeof(var));
+                if constexpr (std::is_standard_layout_v<C>)
+                {
+                    m_location.offset = MemberOffset(var);
+                }
+                else
+                {
+                    m_location.resolve = &ResolveMember<C, T>;
+                }
             }
 
             const std::string& name() const { return m_name; }
 
+            TypeId class_type() const { return m_class_type; }
+
+            TypeId value_type() const { return m_ops != nullptr ? m_ops->type : TypeId {}; }
+
+            // Only meaningful for standard-layout classes; 0 for others.
+            std::size_t offset() const { return m_location.offset; }
+
+            std::size_t size() const { return m_ops != nullptr ? m_ops->size : 0; }
+
+            // Throws BadValueCast if `C` or `T` are not the types of the member.
             template<typename T, typename C>
             T GetValue(const C& c) const
             {
-                return std::any_cast<T>(getter_(&c));
+                CheckClass<C>();
+                return ValueCast<T>(m_ops->get(FieldOf(&c)));
+            }
+
+            template<typename C, typename T>
+            void SetValue(C& c, T val) const
+            {
+                CheckClass<C>();
+                m_ops->set(FieldOf(&c), Value {std::move(val)});
             }
 
+            // Whether the member of `a` and `b` compares equal, by its bytes if its type has no
+            // padding and no == of its own. Throws BadValueCast if `C` is not the class of the
+            // member and std::runtime_error if its type has neither == nor a padding-free layout.
+            template<typename C>
+            bool Equal(const C& a, const C& b) const
+            {
+                CheckClass<C>();
+                return EqualAt(&a, &b);
+            }
+
+            // Assigns the member of `from` to that of `to`. Throws BadValueCast if `C` is not the
+            // class of the member and std::runtime_error if its type cannot be copy-assigned.
+            template<typename C>
+            void Copy(C& to, const C& from) const
+            {
+                CheckClass<C>();
+                CopyAt(&to, &from);
+            }
+
+            // Bulk GetValue and SetValue over `count` consecutive objects; see FieldHandle. The
+            // types are checked once per call. Throws BadValueCast if `C` or `T` are not the types
+            // of the member.
             template<typename C, typename T>
-            void SetValue(C& c, T val)
+            void Gather(const C* objects, std::size_t count, T* out) const
             {
-                setter_(&c, val);
+                CheckedHandle<C, T>().Gather(objects, count, out);
+            }
+
+            template<typename C, typename T>
+            void Scatter(C* objects, std::size_t count, const T* in) const
+            {
+                CheckedHandle<C, T>().Scatter(objects, count, in);
+            }
+
+            // A typed handle to the member, or an invalid one if it is not a `T C::*`.
+            template<typename C, typename T>
+            FieldHandle<C, T> GetHandle() const
+            {
+                if (m_class_type != GetTypeId<C>() || m_ops != &kFieldOps<T>)
+                {
+                    return FieldHandle<C, T> {};
+                }
+                T C::*var;
+                std::memcpy(&var, m_location.member_ptr, sizeof(var));
+                return FieldHandle<C, T> {var};
             }
 
         private:
             friend class RawTypeDescriptorBuilder;
+            friend class TypeDescriptor;
+
+            template<typename C>
+            void CheckClass() const
+            {
+                if (m_class_type != GetTypeId<C>())
+                {
+                    throw BadValueCast {};
+                }
+            }
+
+            template<typename C, typename T>
+            FieldHandle<C, T> CheckedHandle() const
+            {
+                FieldHandle<C, T> handle = GetHandle<C, T>();
+                if (!handle)
+                {
+                    throw BadValueCast {};
+                }
+                return handle;
+            }
+
+            void* FieldOf(void* obj) const { return m_location.In(obj); }
+
+            const void* FieldOf(const void* obj) const { return m_location.In(obj); }
+
+            bool EqualAt(const void* a, const void* b) const;
+
+            void CopyAt(void* to, const void* from) const;
+
+            std::string     m_name;
+            TypeId          m_class_type;
+            MemberLocation  m_location;
+            const FieldOps* m_ops {nullptr};
+        };
+
+        // A parameter of a reflected member function.
+        struct ParamType
+        {
+            // As declared, e.g. `const std::string&`.
+            TypeId type;
+            // Without references and const, e.g. `std::string`.
+            TypeId value_type;
+            // A `T&` or `T&&` parameter, which needs a non-const argument.
+            bool is_mutable_ref {false};
+        };
+
+        template<typename... Args>
+        inline constexpr std::array<ParamType, sizeof...(Args)> kParamTypes = {
+            ParamType {GetTypeId<Args>(),
+                       GetTypeId<std::remove_cv_t<std::remove_reference_t<Args>>>(),
+                       std::is_reference_v<Args> && !std::is_const_v<std::remove_reference_t<Args>>}...};
+
+        // The types of a member function, recorded when it is registered. `param_types` points to
+        // static storage.
+        struct Signature
+        {
+            TypeId           class_type;
+            TypeId           return_type;
+            const ParamType* param_types {nullptr};
+            std::size_t      num_params {0};
+            bool             is_const {false};
+
+            // Whether `R (C::*)(Args...)` can be called through this signature. `C` may be const,
+            // which only matches const member functions.
+            template<typename C, typename R, typename... Args>
+            bool Matches() const
+            {
+                if (class_type != GetTypeId<std::remove_const_t<C>>() || (std::is_const_v<C> && !is_const) ||
+                    return_type != GetTypeId<R>() || num_params != sizeof...(Args))
+                {
+                    return false;
+                }
+                for (std::size_t i = 0; i < num_params; i++)
+                {
+                    if (param_types[i].type != kParamTypes<Args...>[i].type)
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+        };
+
+        // A member function pointer, stored as bytes so that a MemberFunction needs no template
+        // parameters. The Itanium ABI makes them two words; MSVC may need more.
+        struct MethodPointer
+        {
+            alignas(void*) unsigned char bytes[4 * sizeof(void*)];
+        };
+
+        // Calls the member function in `method` on `obj`. `args[i]` points to the i-th argument, an
+        // object of the parameter type without references and const; by-value parameters are copied
+        // from it, `T&&` ones moved. The result, if any, is constructed in `ret` as a ReturnSlot.
+        using Thunk = void (*)(const MethodPointer& method, void* obj, void** args, void* ret);
+
+        // Like Thunk, but returns the result boxed.
+        using BoxedThunk = Value (*)(const MethodPointer& method, void* obj, void** args);
+
+        // Like Thunk, for `count` objects `stride` bytes apart starting at `first`, with the same
+        // arguments each time; results are discarded. `T&&` parameters get a copy of the argument
+        // per call.
+        using BatchThunk =
+            void (*)(const MethodPointer& method, void* first, std::size_t count, std::ptrdiff_t stride, void** args);
+
+        // Where a Thunk puts a result of type `R`: the object itself, or a pointer for references.
+        template<typename R>
+        using ReturnSlot =
+            std::conditional_t<std::is_reference_v<R>, std::remove_reference_t<R>*, std::remove_cv_t<R>>;
+
+        template<typename Arg>
+        decltype(auto) ArgFrom(void* arg)
+        {
+            using Raw = std::remove_cv_t<std::remove_reference_t<Arg>>;
+            if constexpr (std::is_rvalue_reference_v<Arg>)
+            {
+                return std::move(*static_cast<Raw*>(arg));
+            }
+            else
+            {
+                return *static_cast<Raw*>(arg);
+            }
+        }
+
+        // As ArgFrom, but `T&&` parameters get a fresh copy, as the argument is used again.
+        template<typename Arg>
+        decltype(auto) BatchArgFrom(void* arg)
+        {
+            using Raw = std::remove_cv_t<std::remove_reference_t<Arg>>;
+            if constexpr (std::is_rvalue_reference_v<Arg>)
+            {
+                return Raw(*static_cast<Raw*>(arg));
+            }
+            else
+            {
+                return *static_cast<Raw*>(arg);
+            }
+        }
+
+        template<typename Func, typename Obj, typename R, typename... Args, std::size_t... Is>
+        R CallMethod(const MethodPointer& method, void* obj, void** args, std::index_sequence<Is...>)
+        {
+            Func func;
+            std::memcpy(&func, method.bytes, sizeof(Func));
+            return (static_cast<Obj*>(obj)->*func)(ArgFrom<Args>(args[Is])...);
+        }
+
+        template<typename Func, typename Obj, typename R, typename... Args>
+        void MethodThunk(const MethodPointer& method, void* obj, void** args, void* ret)
+        {
+            const auto seq = std::index_sequence_for<Args...> {};
+            if constexpr (std::is_void_v<R>)
+            {
+                CallMethod<Func, Obj, R, Args...>(method, obj, args, seq);
+            }
+            else if constexpr (std::is_reference_v<R>)
+            {
+                ::new (ret) ReturnSlot<R>(&CallMethod<Func, Obj, R, Args...>(method, obj, args, seq));
+            }
+            else
+            {
+                ::new (ret) ReturnSlot<R>(CallMethod<Func, Obj, R, Args...>(method, obj, args, seq));
+            }
+        }
+
+        template<typename Func, typename Obj, typename R, typename... Args, std::size_t... Is>
+        void CallMethodBatch(const MethodPointer& method,
+                             void*                first,
+                             std::size_t          count,
+                             std::ptrdiff_t       stride,
+                             void**               args,
+                             std::index_sequence<Is...>)
+        {
+            Func func;
+            std::memcpy(&func, method.bytes, sizeof(Func));
+            auto* obj = static_cast<unsigned char*>(first);
+            for (std::size_t i = 0; i < count; i++, obj += stride)
+            {
+                (static_cast<Obj*>(static_cast<void*>(obj))->*func)(BatchArgFrom<Args>(args[Is])...);
+            }
+        }
+
+        template<typename Func, typename Obj, typename R, typename... Args>
+        void BatchMethodThunk(const MethodPointer& method,
+                              void*                first,
+                              std::size_t          count,
+                              std::ptrdiff_t       stride,
+                              void**               args)
+        {
+            const auto seq = std::index_sequence_for<Args...> {};
+            CallMethodBatch<Func, Obj, R, Args...>(method, first, count, stride, args, seq);
+        }
+
+        template<typename Func, typename Obj, typename R, typename... Args>
+        Value BoxedMethodThunk(const MethodPointer& method, void* obj, void** args)
+        {
+            const auto seq = std::index_sequence_for<Args...> {};
+            if constexpr (std::is_void_v<R>)
+            {
+                CallMethod<Func, Obj, R, Args...>(method, obj, args, seq);
+                return Value {};
+            }
+            else
+            {
+                return Value {CallMethod<Func, Obj, R, Args...>(method, obj, args, seq)};
+            }
+        }
+
+        // The argument type behind `T`, unwrapping std::ref and std::cref.
+        template<typename T>
+        struct ArgTarget
+        {
+            using type = T;
+        };
+
+        template<typename T>
+        struct ArgTarget<std::reference_wrapper<T>>
+        {
+            using type = T;
+        };
+
+        template<typename T>
+        struct ArgTarget<const std::reference_wrapper<T>>
+        {
+            using type = T;
+        };
+
+        template<typename T>
+        void* ArgAddress(T& arg)
+        {
+            using Target = typename ArgTarget<T>::type;
+            if constexpr (std::is_same_v<Target, T>)
+            {
+                return const_cast<void*>(static_cast<const void*>(std::addressof(arg)));
+            }
+            else
+            {
+                return const_cast<void*>(static_cast<const void*>(std::addressof(arg.get())));
+            }
+        }
+
+        // Typed calls of a member function `R (C::*)(Args...)`, checked once when the handle is
+        // obtained. A call is one indirect call, with no boxing and no allocation.
+        template<typename C, typename R, typename... Args>
+        class MethodHandle
+        {
+        public:
+            MethodHandle() = default;
+
+            MethodHandle(Thunk thunk, const MethodPointer& method)
+                : m_thunk(thunk)
+                , m_method(method)
+            {}
+
+            // False if the member function was not found or has another signature.
+            bool valid() const { return m_thunk != nullptr; }
+
+            explicit operator bool() const { return valid(); }
+
+            R operator()(C& c, std::conditional_t<std::is_reference_v<Args>, Args, const Args&>... args) const
+            {
+                void* obj    = const_cast<void*>(static_cast<const void*>(std::addressof(c)));
+                void* argv[] = {ArgAddress(args)..., nullptr};
+                if constexpr (std::is_void_v<R>)
+                {
+                    m_thunk(m_method, obj, argv, nullptr);
+                }
+                else
+                {
+                    using Slot = ReturnSlot<R>;
+                    alignas(Slot) unsigned char ret[sizeof(Slot)];
+                    m_thunk(m_method, obj, argv, ret);
+                    Slot* slot = std::launder(reinterpret_cast<Slot*>(ret));
+                    if constexpr (std::is_reference_v<R>)
+                    {
+                        return static_cast<R>(**slot);
+                    }
+                    else
+                    {
+                        R res = std::move(*slot);
+                        slot->~Slot();
+                        return res;
+                    }
+                }
+            }
 
-            std::string                             m_name;
-            std::function<std::any(std::any)>       getter_ {nullptr};
-            std::function<void(std::any, std::any)> setter_ {nullptr};
+        private:
+            Thunk         m_thunk {nullptr};
+            MethodPointer m_method {};
         };
 
         class MemberFunction
@@ -63,120 +493,316 @@ namespace reflect
             template<typename C, typename R, typename... Args>
             explicit MemberFunction(R (C::*func)(Args...))
             {
-                m_function = [this, func](std::any obj_args) -> std::any {
-                    using tuple_t = std::tuple<C&, Args...>;
-                    // How to debug compile-time types...
-                    // static_assert(std::is_same<tuple_t, void>::value, "Hoi!");
-                    auto* tp_ptr = std::any_cast<tuple_t*>(obj_args);
-                    return std::apply(func, *tp_ptr);
-                };
-            }
-
-            template<typename C, typename... Args>
-            explicit MemberFunction(void (C::*func)(Args...))
-            {
-                m_function = [this, func](std::any obj_args) -> std::any {
-                    using tuple_t = std::tuple<C&, Args...>;
-                    auto* tp_ptr  = std::any_cast<tuple_t*>(obj_args);
-                    std::apply(func, *tp_ptr);
-                    return std::any {};
-                };
+                Init<C, R, Args...>(func);
             }
 
             template<typename C, typename R, typename... Args>
             explicit MemberFunction(R (C::*func)(Args...) const)
             {
-                m_function = [this, func](std::any obj_args) -> std::any {
-                    using tuple_t = std::tuple<const C&, Args...>;
-                    // How to debug compile-time types...
-                    // static_assert(std::is_same<tuple_t, void>::value, "Hoi!");
-                    auto* tp_ptr = std::any_cast<tuple_t*>(obj_args);
-                    return std::apply(func, *tp_ptr);
-                };
-                m_is_const = true;
+                Init<const C, R, Args...>(func);
             }
 
+            const std::string& name() const { return m_name; }
+
+            bool is_const() const { return m_signature.is_const; }
+
+            const Signature& signature() const { return m_signature; }
+
+            // Arguments may be passed as values, references, std::ref or std::cref of the parameter
+            // types. Throws BadValueCast if they, or `C`, do not fit the signature.
             template<typename C, typename... Args>
-            explicit MemberFunction(void (C::*func)(Args...) const)
+            Value Invoke(C& c, Args&&... args) const
             {
-                m_function = [this, func](std::any obj_args) -> std::any {
-                    using tuple_t = std::tuple<const C&, Args...>;
-                    auto* tp_ptr  = std::any_cast<tuple_t*>(obj_args);
-                    std::apply(func, *tp_ptr);
-                    return std::any {};
-                };
-                m_is_const = true;
+                if (!Accepts<C, Args...>())
+                {
+                    throw BadValueCast {};
+                }
+                void* obj    = const_cast<void*>(static_cast<const void*>(std::addressof(c)));
+                void* argv[] = {ArgAddress(args)..., nullptr};
+                return m_boxed_thunk(m_method, obj, argv);
             }
 
-            const std::string& name() const { return m_name; }
+            // Calls the member function on `count` objects starting at `objects`, with the same
+            // arguments. They are checked once; the loop over the objects makes direct calls.
+            // Results are discarded.
+            template<typename C, typename... Args>
+            void InvokeBatch(C* objects, std::size_t count, Args&&... args) const
+            {
+                InvokeBatchStrided(objects, count, sizeof(C), std::forward<Args>(args)...);
+            }
 
-            bool is_const() const { return m_is_const; }
+            // As InvokeBatch, for objects `stride` bytes apart, e.g. the `C` members of an array of
+            // bigger structs.
+            template<typename C, typename... Args>
+            void InvokeBatchStrided(C* first, std::size_t count, std::ptrdiff_t stride, Args&&... args) const
+            {
+                if (!AcceptsBatch<C, Args...>())
+                {
+                    throw BadValueCast {};
+                }
+                void* argv[] = {ArgAddress(args)..., nullptr};
+                m_batch_thunk(m_method, const_cast<void*>(static_cast<const void*>(first)), count, stride, argv);
+            }
 
+            // As InvokeBatch, with the objects split into chunks that run on `pool`. All calls share
+            // the same arguments, so mutable references to them are shared between threads.
             template<typename C, typename... Args>
-            std::any Invoke(C& c, Args&&... args)
+            void InvokeBatch(ThreadPool& pool, C* objects, std::size_t count, Args&&... args) const
             {
-                if (m_is_const)
+                if (!AcceptsBatch<C, Args...>())
                 {
-                    auto tp = std::make_tuple(std::reference_wrapper<const C>(c), args...);
-                    return m_function(&tp);
+                    throw BadValueCast {};
                 }
-                auto tp = std::make_tuple(std::reference_wrapper<C>(c), args...);
-                return m_function(&tp);
+                void*             argv[]     = {ArgAddress(args)..., nullptr};
+                void*             first      = const_cast<void*>(static_cast<const void*>(objects));
+                const std::size_t chunk      = std::max(kMinBatchChunk, count / (4 * pool.concurrency()) + 1);
+                const std::size_t num_chunks = (count + chunk - 1) / chunk;
+                pool.Run(num_chunks, [&](std::size_t i) {
+                    const std::size_t begin = i * chunk;
+                    m_batch_thunk(m_method,
+                                  static_cast<unsigned char*>(first) + begin * sizeof(C),
+                                  std::min(chunk, count - begin),
+                                  sizeof(C),
+                                  argv);
+                });
+            }
+
+            // A typed handle to the member function, or an invalid one if it is not a
+            // `R (C::*)(Args...)`. For const member functions, `C` may be const.
+            template<typename C, typename R, typename... Args>
+            MethodHandle<C, R, Args...> GetHandle() const
+            {
+                if (m_thunk == nullptr || !m_signature.Matches<C, R, Args...>())
+                {
+                    return MethodHandle<C, R, Args...> {};
+                }
+                return MethodHandle<C, R, Args...> {m_thunk, m_method};
             }
 
         private:
             friend class RawTypeDescriptorBuilder;
 
-            std::string                       m_name;
-            bool                              m_is_const {false};
-            std::function<std::any(std::any)> m_function {nullptr};
-        };
+            template<typename Obj, typename R, typename... Args, typename Func>
+            void Init(Func func)
+            {
+                static_assert(sizeof(Func) <= sizeof(MethodPointer::bytes), "member function pointer too big");
+                std::memcpy(m_method.bytes, &func, sizeof(Func));
+                m_thunk       = &MethodThunk<Func, Obj, R, Args...>;
+                m_boxed_thunk = &BoxedMethodThunk<Func, Obj, R, Args...>;
+                if constexpr (((!std::is_rvalue_reference_v<Args> ||
+                                std::is_copy_constructible_v<std::remove_cv_t<std::remove_reference_t<Args>>>) &&
+                               ...))
+                {
+                    m_batch_thunk = &BatchMethodThunk<Func, Obj, R, Args...>;
+                }
+                m_signature   = Signature {GetTypeId<std::remove_const_t<Obj>>(),
+                                         GetTypeId<R>(),
+                                         kParamTypes<Args...>.data(),
+                                         sizeof...(Args),
+                                         std::is_const_v<Obj>};
+            }
 
-        class TypeDescriptor
-        {
-        public:
-            const std::string& name() const { return m_name; }
+            template<typename Arg>
+            static bool AcceptsArg(const ParamType& param)
+            {
+                using Target = typename ArgTarget<std::remove_reference_t<Arg>>::type;
+                return param.value_type == GetTypeId<std::remove_cv_t<Target>>() &&
+                       !(param.is_mutable_ref && std::is_const_v<Target>);
+            }
 
-            const std::vector<MemberVariable>& member_vars() const { return m_member_vars; }
+            template<typename C, typename... Args>
+            bool Accepts() const
+            {
+                if (m_boxed_thunk == nullptr || m_signature.class_type != GetTypeId<std::remove_const_t<C>>() ||
+                    (std::is_const_v<C> && !m_signature.is_const) || m_signature.num_params != sizeof...(Args))
+                {
+                    return false;
+                }
+                std::size_t i = 0;
+                return (true && ... && AcceptsArg<Args>(m_signature.param_types[i++]));
+            }
 
-            const std::vector<MemberFunction>& member_funcs() const { return m_member_funcs; }
+            template<typename C, typename... Args>
+            bool AcceptsBatch() const
+            {
+                return m_batch_thunk != nullptr && Accepts<C, Args...>();
+            }
+
+            // Fewer objects per thread are not worth waking it.
+            static constexpr std::size_t kMinBatchChunk = 1024;
+
+            std::string   m_name;
+            Signature     m_signature;
+            MethodPointer m_method {};
+            Thunk         m_thunk {nullptr};
+            BoxedThunk    m_boxed_thunk {nullptr};
+            // Null if a `T&&` parameter cannot be copied for each call.
+            BatchThunk m_batch_thunk {nullptr};
+        };
 
-            MemberVariable GetMemberVar(const std::string& name) const
+        // Immutable open-addressing table from member names to their positions in a vector,
+        // built once all members are known. Slots keep the full hash, so a probe only compares
+        // strings on a hash match. Positions rather than pointers keep it valid in copies.
+        class NameIndex
+        {
+        public:
+            template<typename Item>
+            void Build(const std::vector<Item>& items)
             {
-                for (const auto& mv : m_member_vars)
+                std::size_t capacity = 1;
+                // At most half full, so that probe sequences stay short.
+                while (capacity < 2 * items.size())
                 {
-                    if (mv.name() == name)
+                    capacity *= 2;
+                }
+                m_slots.assign(capacity, Slot {});
+                for (std::size_t i = 0; i < items.size(); i++)
+                {
+                    const uint64_t hash = HashName(items[i].name());
+                    std::size_t    pos  = hash & (capacity - 1);
+                    bool           seen = false;
+                    while (m_slots[pos].index != kEmpty && !seen)
+                    {
+                        const Slot& slot = m_slots[pos];
+                        seen = slot.hash == hash && items[slot.index].name() == items[i].name();
+                        pos  = (pos + 1) & (capacity - 1);
+                    }
+                    if (!seen)
                     {
-                        return mv;
+                        m_slots[pos] = Slot {hash, static_cast<uint32_t>(i)};
                     }
                 }
-                return MemberVariable {};
             }
 
-            MemberFunction GetMemberFunc(const std::string& name) const
+            // The item named `name`, or nullptr. Of equal names, only the first one is indexed.
+            template<typename Item>
+            const Item* Find(const std::vector<Item>& items, std::string_view name) const
             {
-                for (const auto& mf : m_member_funcs)
+                if (m_slots.empty())
+                {
+                    return nullptr;
+                }
+                const uint64_t    hash = HashName(name);
+                const std::size_t mask = m_slots.size() - 1;
+                for (std::size_t pos = hash & mask; m_slots[pos].index != kEmpty; pos = (pos + 1) & mask)
                 {
-                    if (mf.name() == name)
+                    const Slot& slot = m_slots[pos];
+                    if (slot.hash == hash && items[slot.index].name() == name)
                     {
-                        return mf;
+                        return &items[slot.index];
                     }
                 }
-                return MemberFunction {};
+                return nullptr;
             }
 
+        private:
+            static constexpr uint32_t kEmpty = UINT32_MAX;
+
+            struct Slot
+            {
+                uint64_t hash {0};
+                uint32_t index {kEmpty};
+            };
+
+            std::vector<Slot> m_slots;
+        };
+
+        class TypeDescriptor
+        {
+        public:
+            // The empty descriptor of a type that is not registered.
+            static const TypeDescriptor& None()
+            {
+                static const TypeDescriptor kNone {};
+                return kNone;
+            }
+
+            const std::string& name() const { return m_name; }
+
+            TypeId type_id() const { return m_type_id; }
+
+            const std::vector<MemberVariable>& member_vars() const { return m_member_vars; }
+
+            const std::vector<MemberFunction>& member_funcs() const { return m_member_funcs; }
+
+            // nullptr if there is no such member.
+            const MemberVariable* FindMemberVar(std::string_view name) const
+            {
+                return m_member_var_index.Find(m_member_vars, name);
+            }
+
+            const MemberFunction* FindMemberFunc(std::string_view name) const
+            {
+                return m_member_func_index.Find(m_member_funcs, name);
+            }
+
+            // An empty MemberVariable if there is no such member. The reference stays valid as long
+            // as the descriptor.
+            const MemberVariable& GetMemberVar(std::string_view name) const
+            {
+                static const MemberVariable kNone {};
+                const MemberVariable*       mv = FindMemberVar(name);
+                return mv != nullptr ? *mv : kNone;
+            }
+
+            template<typename C, typename T>
+            FieldHandle<C, T> GetField(std::string_view name) const
+            {
+                return GetMemberVar(name).GetHandle<C, T>();
+            }
+
+            const MemberFunction& GetMemberFunc(std::string_view name) const
+            {
+                static const MemberFunction kNone {};
+                const MemberFunction*       mf = FindMemberFunc(name);
+                return mf != nullptr ? *mf : kNone;
+            }
+
+            template<typename C, typename R, typename... Args>
+            MethodHandle<C, R, Args...> GetMethod(std::string_view name) const
+            {
+                return GetMemberFunc(name).GetHandle<C, R, Args...>();
+            }
+
+            // Whether all member variables of `a` and `b`, two objects of this type, compare
+            // equal; see MemberVariable::Equal. Throws std::runtime_error if one of them can be
+            // compared neither by == nor by its bytes.
+            bool Equal(const void* a, const void* b) const;
+
+            // Assigns all member variables of `from` to those of `to`, two objects of this type.
+            // Throws std::runtime_error, before assigning any, if one of them cannot be assigned.
+            void CopyMembers(void* to, const void* from) const;
+
+            // How Serialize writes the member variables.
+            const FieldPlan& serial_plan() const { return m_serial_plan; }
+
         private:
             friend class RawTypeDescriptorBuilder;
 
+            void BuildIndex()
+            {
+                m_member_var_index.Build(m_member_vars);
+                m_member_func_index.Build(m_member_funcs);
+            }
+
+            // The plans for Equal, CopyMembers and Serialize.
+            void BuildPlans();
+
             std::string                 m_name;
+            TypeId                      m_type_id;
             std::vector<MemberVariable> m_member_vars;
             std::vector<MemberFunction> m_member_funcs;
+            NameIndex                   m_member_var_index;
+            NameIndex                   m_member_func_index;
+            FieldPlan                   m_compare_plan;
+            FieldPlan                   m_copy_plan;
+            FieldPlan                   m_serial_plan;
         };
 
         class RawTypeDescriptorBuilder
         {
         public:
-            explicit RawTypeDescriptorBuilder(const std::string& name);
+            RawTypeDescriptorBuilder(const std::string& name, TypeId type_id);
 
             ~RawTypeDescriptorBuilder();
             RawTypeDescriptorBuilder(const RawTypeDescriptorBuilder&)            = delete;
@@ -200,6 +826,9 @@ namespace reflect
                 desc_->m_member_funcs.push_back(std::move(mf));
             }
 
+            // Finishes the descriptor without registering it; the destructor then does nothing.
+            std::unique_ptr<TypeDescriptor> Build();
+
         private:
             std::unique_ptr<TypeDescriptor> desc_ {nullptr};
         };
@@ -209,7 +838,7 @@ namespace reflect
         {
         public:
             explicit TypeDescriptorBuilder(const std::string& name)
-                : raw_builder_(name)
+                : raw_builder_(name, GetTypeId<T>())
             {}
 
             template<typename V>
@@ -230,6 +859,52 @@ namespace reflect
             RawTypeDescriptorBuilder raw_builder_;
         };
 
+        // A type declared with StaticClass: its name, its id and its constant member list, which
+        // become a TypeDescriptor the first time the type is looked up.
+        class StaticTypeEntry
+        {
+        public:
+            using AddMembers = void (*)(const void* members, RawTypeDescriptorBuilder& builder);
+
+            // Links the entry into the list the registry reads on lookups. Does not allocate.
+            StaticTypeEntry(std::string_view name, TypeId type_id, const void* members, AddMembers add_members);
+
+            StaticTypeEntry(const StaticTypeEntry&)            = delete;
+            StaticTypeEntry& operator=(const StaticTypeEntry&) = delete;
+
+            std::string_view name() const { return m_name; }
+
+            TypeId type_id() const { return m_type_id; }
+
+        private:
+            friend class Registry;
+
+            // The last entry linked; the others follow through `m_next`.
+            static std::atomic<StaticTypeEntry*>& head()
+            {
+                static std::atomic<StaticTypeEntry*> inst {nullptr};
+                return inst;
+            }
+
+            std::string_view m_name;
+            TypeId           m_type_id;
+            const void*      m_members {nullptr};
+            AddMembers       m_add_members {nullptr};
+            StaticTypeEntry* m_next {nullptr};
+            // Built on first lookup, owned by the registry.
+            std::atomic<const TypeDescriptor*> m_desc {nullptr};
+        };
+
+        // All registered types. Until Freeze, lookups take a lock. Freeze publishes an immutable
+        // snapshot of the types, which lookups then read without locking or writing anything.
+        // Registrations after it only mark the snapshot stale; the next lookup publishes them all
+        // in one new snapshot, so a burst of late registrations costs one copy of the maps.
+        // Snapshots and descriptors that are replaced stay alive until Clear, since lookups may
+        // still be using them.
+        //
+        // Entries of StaticClass are added to the maps by the first lookup after they were linked,
+        // and each is built by the first lookup of its type. Types registered by name at runtime
+        // take precedence over them.
         class Registry
         {
         public:
@@ -239,14 +914,58 @@ namespace reflect
                 return inst;
             }
 
-            TypeDescriptor* Find(const std::string& name);
+            // nullptr if no type with this name is registered.
+            const TypeDescriptor* Find(std::string_view name);
+
+            // nullptr if no type with this id is registered.
+            const TypeDescriptor* Find(TypeId type_id);
 
+            // Replaces any type with the same name.
             void Register(std::unique_ptr<TypeDescriptor> desc);
 
+            // Call once the types known up front are registered, e.g. at the start of main.
+            void Freeze();
+
+            bool frozen() const { return m_snapshot.load(std::memory_order_acquire) != nullptr; }
+
+            // Destroys all types, and undoes Freeze. Must not run concurrently with lookups.
             void Clear();
 
         private:
-            std::unordered_map<std::string, std::unique_ptr<TypeDescriptor>> type_descs_;
+            struct Snapshot
+            {
+                // Keyed by the names of the descriptors and entries.
+                std::unordered_map<std::string_view, const TypeDescriptor*>   names;
+                std::unordered_map<TypeId, const TypeDescriptor*, TypeIdHash> ids;
+                std::unordered_map<std::string_view, StaticTypeEntry*>        static_names;
+                std::unordered_map<TypeId, StaticTypeEntry*, TypeIdHash>      static_ids;
+            };
+
+            template<typename Key, typename Descs, typename Statics>
+            const TypeDescriptor* Find(const Key& key, Descs Snapshot::*descs, Statics Snapshot::*statics);
+
+            // Adds the entries linked since the last call to the maps.
+            void LinkStaticTypes();
+
+            const TypeDescriptor* BuildStaticType(StaticTypeEntry& entry);
+
+            // Takes `m_mutex`.
+            void Publish();
+
+            // On their own cache line, so that lookups do not contend with writes to `m_mutex`.
+            alignas(64) std::atomic<const Snapshot*> m_snapshot {nullptr};
+            // Whether types were registered or linked since the last snapshot.
+            std::atomic<bool> m_stale {false};
+            // The head of the StaticTypeEntry list when it was last linked.
+            std::atomic<StaticTypeEntry*> m_linked {nullptr};
+
+            alignas(64) std::mutex m_mutex;
+            // The current types, which the last snapshot is a copy of.
+            Snapshot m_types;
+            // Including the ones that were replaced.
+            std::vector<std::unique_ptr<TypeDescriptor>> m_descs;
+            // The current snapshot and the ones it replaced.
+            std::vector<std::unique_ptr<Snapshot>> m_snapshots;
         };
 
     } // namespace details
@@ -258,8 +977,104 @@ namespace reflect
         return b;
     }
 
-    details::TypeDescriptor& GetByName(const std::string& name);
+    // nullptr if no such type is registered.
+    inline const details::TypeDescriptor* FindByName(std::string_view name)
+    {
+        return details::Registry::instance().Find(name);
+    }
+
+    template<typename T>
+    const details::TypeDescriptor* FindByType()
+    {
+        return details::Registry::instance().Find(GetTypeId<T>());
+    }
+
+    // An empty descriptor, whose type_id() is not valid(), if no such type is registered. The
+    // reference stays valid until ClearRegistry.
+    const details::TypeDescriptor& GetByName(std::string_view name);
+
+    template<typename T>
+    const details::TypeDescriptor& GetByType()
+    {
+        const details::TypeDescriptor* desc = FindByType<T>();
+        return desc != nullptr ? *desc : details::TypeDescriptor::None();
+    }
+
+    // Makes lookups lock-free from here on; see Registry.
+    void FreezeRegistry();
 
     void ClearRegistry();
 
+    namespace details
+    {
+
+        // The member pointer `M` as one to a member of `C`, which `M` converts to if it points to a
+        // member of a base of `C`. Member functions are covered too, with `T` a function type.
+        template<typename C, typename M>
+        struct AsMemberOf;
+
+        template<typename C, typename T, typename B>
+        struct AsMemberOf<C, T B::*>
+        {
+            static_assert(std::is_base_of_v<B, C>, "not a member of the class or of one of its bases");
+            using type = T C::*;
+        };
+
+    } // namespace details
+
+    // One entry of the member list of a StaticClass: a member variable or member function.
+    template<typename M>
+    struct Member
+    {
+        constexpr Member(std::string_view name, M ptr)
+            : name(name)
+            , ptr(ptr)
+        {}
+
+        std::string_view name;
+        M                ptr;
+    };
+
+    // A type registered from a constant member list, e.g.
+    //
+    //     static constexpr std::tuple kMembers {reflect::Member {"x", &Foo::x}, ...};
+    //     const reflect::StaticClass<Foo> kFooClass {"Foo", Foo::kMembers};
+    //
+    // Constructing it only links it into a list; the TypeDescriptor is built the first time the
+    // type is looked up, so types that never are cost next to nothing at startup. `name` and
+    // `members` must outlive the StaticClass, e.g. as a string literal and a static constexpr.
+    template<typename C>
+    class StaticClass : public details::StaticTypeEntry
+    {
+    public:
+        template<typename... Ms>
+        StaticClass(std::string_view name, const std::tuple<Member<Ms>...>& members)
+            : StaticTypeEntry(name, GetTypeId<C>(), &members, &AddMembers<Ms...>)
+        {}
+
+    private:
+        template<typename... Ms>
+        static void AddMembers(const void* members, details::RawTypeDescriptorBuilder& builder)
+        {
+            std::apply([&builder](const auto&... member) { (AddMember(builder, member), ...); },
+                       *static_cast<const std::tuple<Member<Ms>...>*>(members));
+        }
+
+        // Members inherited from a base, e.g. `Member {"b", &C::b}` of type `int Base::*`, are
+        // converted to members of `C`, so that they get the class id and offset of `C`.
+        template<typename M>
+        static void AddMember(details::RawTypeDescriptorBuilder& builder, const Member<M>& member)
+        {
+            const auto ptr = static_cast<typename details::AsMemberOf<C, M>::type>(member.ptr);
+            if constexpr (std::is_member_object_pointer_v<M>)
+            {
+                builder.AddMemberVar(std::string {member.name}, ptr);
+            }
+            else
+            {
+                builder.AddMemberFunc(std::string {member.name}, ptr);
+            }
+        }
+    };
+
 } // namespace reflect
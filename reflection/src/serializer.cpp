@@ -0,0 +1,85 @@
+#include "serializer.hpp"
+
+#include <stdexcept>
+#include <string>
+
+namespace reflect
+{
+    namespace
+    {
+        void CheckSerializable(const details::TypeDescriptor& type)
+        {
+            if (!type.serial_plan().unsupported_member.empty())
+            {
+                throw std::runtime_error("reflect: member `" + type.serial_plan().unsupported_member + "` of `" +
+                                         type.name() + "` cannot be serialized");
+            }
+        }
+
+        const details::TypeDescriptor& FindType(TypeId type_id)
+        {
+            const details::TypeDescriptor* type = details::Registry::instance().Find(type_id);
+            if (type == nullptr)
+            {
+                throw std::runtime_error("reflect: serialized type is not registered");
+            }
+            return *type;
+        }
+    } // namespace
+
+    void Serialize(const details::TypeDescriptor& type, const void* obj, std::vector<uint8_t>& out)
+    {
+        CheckSerializable(type);
+        for (const auto& step : type.serial_plan().steps)
+        {
+            const void* field = step.location.In(obj);
+            if (step.size != 0)
+            {
+                const std::size_t pos = out.size();
+                out.resize(pos + step.size);
+                std::memcpy(out.data() + pos, field, step.size);
+            }
+            else
+            {
+                step.ops->codec.write(field, out);
+            }
+        }
+    }
+
+    std::size_t Deserialize(const details::TypeDescriptor& type, void* obj, const uint8_t* data, std::size_t size)
+    {
+        CheckSerializable(type);
+        std::size_t pos = 0;
+        for (const auto& step : type.serial_plan().steps)
+        {
+            void* field = step.location.In(obj);
+            if (step.size != 0)
+            {
+                details::CheckAvailable(step.size, size - pos);
+                std::memcpy(field, data + pos, step.size);
+                pos += step.size;
+            }
+            else
+            {
+                pos += step.ops->codec.read(field, data + pos, size - pos);
+            }
+        }
+        return pos;
+    }
+
+    namespace details
+    {
+
+        void WriteObject(TypeId type, const void* obj, std::vector<uint8_t>& out)
+        {
+            Serialize(FindType(type), obj, out);
+        }
+
+        std::size_t ReadObject(TypeId type, void* obj, const uint8_t* data, std::size_t size)
+        {
+            return Deserialize(FindType(type), obj, data, size);
+        }
+
+    } // namespace details
+
+} // namespace reflect
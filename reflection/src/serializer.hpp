@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "reflect.hpp"
+
+namespace reflect
+{
+
+    // Binary serialization of registered types through their member variables, in registration
+    // order. Members may be trivially copyable, std::string, std::vector of trivially copyable
+    // elements, or registered types themselves. Each type's plan is compiled when it is
+    // registered, merging adjacent trivially copyable members into single copies, so types known
+    // only at runtime serialize as fast as static ones.
+    //
+    // Raw members are written in native byte order, and lengths as 64-bit integers, so the
+    // format is only portable between machines of the same endianness.
+
+    // Appends the members of `obj`, an object of type `type`, to `out`. Throws std::runtime_error
+    // if a member cannot be serialized.
+    void Serialize(const details::TypeDescriptor& type, const void* obj, std::vector<uint8_t>& out);
+
+    // Reads the members of `obj` from `data` and returns the number of bytes read. Throws
+    // std::runtime_error if `size` is too short.
+    std::size_t Deserialize(const details::TypeDescriptor& type, void* obj, const uint8_t* data, std::size_t size);
+
+    // As above, for a type registered with AddClass<T>. Throws std::runtime_error if it is not.
+    template<typename T>
+    void Serialize(const T& obj, std::vector<uint8_t>& out)
+    {
+        details::WriteObject(GetTypeId<T>(), &obj, out);
+    }
+
+    template<typename T>
+    std::size_t Deserialize(T& obj, const uint8_t* data, std::size_t size)
+    {
+        return details::ReadObject(GetTypeId<T>(), &obj, data, size);
+    }
+
+} // namespace reflect
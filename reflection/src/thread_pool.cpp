@@ -0,0 +1,126 @@
+#include "thread_pool.hpp"
+
+namespace reflect
+{
+    ThreadPool::ThreadPool(std::size_t num_threads)
+    {
+        m_workers.reserve(num_threads);
+        for (std::size_t i = 0; i < num_threads; i++)
+        {
+            m_workers.emplace_back([this] { Work(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock {m_mutex};
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::Run(std::size_t num_tasks, const std::function<void(std::size_t)>& task)
+    {
+        if (num_tasks == 0)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> run_lock {m_run_mutex};
+        {
+            std::lock_guard<std::mutex> lock {m_mutex};
+            m_task      = &task;
+            m_num_tasks = num_tasks;
+            m_next.store(0, std::memory_order_relaxed);
+            m_failed.store(false, std::memory_order_relaxed);
+            m_finished = 0;
+            m_error    = nullptr;
+            m_generation++;
+        }
+        m_wake.notify_all();
+
+        Drain(task, num_tasks);
+
+        std::unique_lock<std::mutex> lock {m_mutex};
+        m_done.wait(lock, [this] { return m_finished == m_num_tasks && m_active == 0; });
+        m_task = nullptr;
+        if (m_error != nullptr)
+        {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+    void ThreadPool::Work()
+    {
+        std::size_t seen = 0;
+        while (true)
+        {
+            const std::function<void(std::size_t)>* task      = nullptr;
+            std::size_t                             num_tasks = 0;
+            {
+                std::unique_lock<std::mutex> lock {m_mutex};
+                m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+                if (m_stop)
+                {
+                    return;
+                }
+                seen = m_generation;
+                if (m_task == nullptr)
+                {
+                    // Woken too late for that run.
+                    continue;
+                }
+                task      = m_task;
+                num_tasks = m_num_tasks;
+                m_active++;
+            }
+            Drain(*task, num_tasks);
+            {
+                std::lock_guard<std::mutex> lock {m_mutex};
+                m_active--;
+            }
+            m_done.notify_one();
+        }
+    }
+
+    void ThreadPool::Drain(const std::function<void(std::size_t)>& task, std::size_t num_tasks)
+    {
+        std::size_t done = 0;
+        for (std::size_t i = m_next.fetch_add(1); i < num_tasks; i = m_next.fetch_add(1))
+        {
+            // After a failure, the remaining tasks are only counted.
+            if (!m_failed.load(std::memory_order_relaxed))
+            {
+                try
+                {
+                    task(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock {m_mutex};
+                    if (m_error == nullptr)
+                    {
+                        m_error = std::current_exception();
+                    }
+                    m_failed.store(true, std::memory_order_relaxed);
+                }
+            }
+            done++;
+        }
+        if (done == 0)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock {m_mutex};
+        m_finished += done;
+        if (m_finished == num_tasks)
+        {
+            m_done.notify_one();
+        }
+    }
+
+} // namespace reflect
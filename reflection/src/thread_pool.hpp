@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace reflect
+{
+
+    // A fixed set of worker threads that run the tasks of one Run call at a time. The calling
+    // thread works on the tasks too.
+    class ThreadPool
+    {
+    public:
+        // `num_threads` workers besides the calling thread; 0 runs everything on the caller. By
+        // default one per hardware thread, where hardware_concurrency() may report 0 if unknown.
+        explicit ThreadPool(std::size_t num_threads = std::max(std::thread::hardware_concurrency(), 1u) - 1);
+
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&)            = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Threads working on a Run, the caller included.
+        std::size_t concurrency() const { return m_workers.size() + 1; }
+
+        // Calls `task(i)` for each i in [0, num_tasks) and returns when all calls have returned.
+        // If any throws, the remaining tasks are skipped and the first exception is rethrown.
+        void Run(std::size_t num_tasks, const std::function<void(std::size_t)>& task);
+
+    private:
+        void Work();
+
+        // Takes tasks of the current run until there are none left.
+        void Drain(const std::function<void(std::size_t)>& task, std::size_t num_tasks);
+
+        std::vector<std::thread> m_workers;
+        std::mutex               m_mutex;
+        std::condition_variable  m_wake;
+        std::condition_variable  m_done;
+        // Serializes Run calls from different threads.
+        std::mutex m_run_mutex;
+
+        // The current run; null between runs.
+        const std::function<void(std::size_t)>* m_task {nullptr};
+        std::size_t                             m_num_tasks {0};
+        std::atomic<std::size_t>                m_next {0};
+        std::atomic<bool>                       m_failed {false};
+        std::size_t                             m_finished {0};
+        // Workers inside Drain, which a run waits for before it returns.
+        std::size_t        m_active {0};
+        std::size_t        m_generation {0};
+        std::exception_ptr m_error;
+        bool               m_stop {false};
+    };
+
+} // namespace reflect
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace reflect
+{
+    namespace details
+    {
+
+        constexpr uint64_t HashName(std::string_view name)
+        {
+            // FNV-1a
+            uint64_t hash = 14695981039346656037ull;
+            for (char c : name)
+            {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+    } // namespace details
+
+    // The name of `T` as spelled by the compiler, taken from the signature of this function. Needs
+    // no RTTI, and is a constant expression.
+    template<typename T>
+    constexpr std::string_view GetTypeName()
+    {
+#if defined(_MSC_VER)
+        std::string_view name   = __FUNCSIG__;
+        std::string_view prefix = "GetTypeName<";
+        std::string_view suffix = ">(void)";
+#else
+        std::string_view name   = __PRETTY_FUNCTION__;
+        std::string_view prefix = "T = ";
+        std::string_view suffix = "]";
+#endif
+        name.remove_prefix(name.find(prefix) + prefix.size());
+        name.remove_suffix(name.size() - name.rfind(suffix));
+#if !defined(_MSC_VER)
+        // GCC appends "; std::string_view = ..." to the template arguments.
+        name = name.substr(0, name.find(';'));
+#endif
+        return name;
+    }
+
+    // Identifies a type without RTTI: by the address of a per-type tag, so that type checks are
+    // pointer comparisons, and by the hash of its name for hash maps. The hash alone is not enough:
+    // types with internal linkage that are spelled alike, e.g. `{anonymous}::Foo` in two files, get
+    // the same one. Ids are only comparable within one process.
+    class TypeId
+    {
+    public:
+        constexpr TypeId() = default;
+
+        constexpr TypeId(uint64_t value, const void* tag)
+            : m_value(value)
+            , m_tag(tag)
+        {}
+
+        constexpr uint64_t value() const { return m_value; }
+
+        // The id of no type, e.g. of an empty Value.
+        constexpr bool valid() const { return m_tag != nullptr; }
+
+        constexpr bool operator==(TypeId other) const { return m_tag == other.m_tag; }
+
+        constexpr bool operator!=(TypeId other) const { return m_tag != other.m_tag; }
+
+    private:
+        uint64_t    m_value {0};
+        const void* m_tag {nullptr};
+    };
+
+    namespace details
+    {
+
+        // One object per type, and per translation unit for types with internal linkage.
+        template<typename T>
+        inline constexpr char kTypeTag {};
+
+        // A variable, so that the hash is always computed at compile time.
+        template<typename T>
+        inline constexpr TypeId kTypeId {HashName(GetTypeName<T>()), &kTypeTag<T>};
+
+    } // namespace details
+
+    template<typename T>
+    constexpr TypeId GetTypeId()
+    {
+        return details::kTypeId<T>;
+    }
+
+    struct TypeIdHash
+    {
+        std::size_t operator()(TypeId id) const { return static_cast<std::size_t>(id.value()); }
+    };
+
+} // namespace reflect
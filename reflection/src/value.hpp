@@ -0,0 +1,394 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace reflect
+{
+    namespace details
+    {
+
+        // Blocks for values too big to be stored inline. Freed blocks are kept in thread-local free
+        // lists per power-of-two size class, so that boxing the same kinds of values again does not
+        // go to the heap. Blocks above kMaxPooledSize come from operator new directly.
+        class ValuePool
+        {
+        public:
+            static constexpr std::size_t kMinPooledSize = 64;
+            static constexpr std::size_t kMaxPooledSize = 4096;
+
+            static void* Allocate(std::size_t size)
+            {
+                const int cls = SizeClass(size);
+                if (cls < 0)
+                {
+                    return ::operator new(size);
+                }
+                FreeList& list = Lists()[cls];
+                if (list.head != nullptr)
+                {
+                    Block* block = list.head;
+                    list.head    = block->next;
+                    list.count--;
+                    return block;
+                }
+                return ::operator new(kMinPooledSize << cls);
+            }
+
+            static void Deallocate(void* ptr, std::size_t size)
+            {
+                const int cls = SizeClass(size);
+                if (cls < 0 || Lists()[cls].count == kMaxBlocksPerClass)
+                {
+                    ::operator delete(ptr);
+                    return;
+                }
+                FreeList& list = Lists()[cls];
+                list.head      = ::new (ptr) Block {list.head};
+                list.count++;
+            }
+
+        private:
+            static constexpr int         kNumClasses        = 7; // 64 B ... 4 KiB
+            static constexpr std::size_t kMaxBlocksPerClass = 64;
+
+            struct Block
+            {
+                Block* next;
+            };
+
+            struct FreeList
+            {
+                Block*      head {nullptr};
+                std::size_t count {0};
+
+                ~FreeList()
+                {
+                    while (head != nullptr)
+                    {
+                        Block* next = head->next;
+                        ::operator delete(head);
+                        head = next;
+                    }
+                    // Values destroyed after the thread's pool, e.g. statics, free their blocks
+                    // directly.
+                    count = kMaxBlocksPerClass;
+                }
+            };
+
+            static int SizeClass(std::size_t size)
+            {
+                if (size > kMaxPooledSize)
+                {
+                    return -1;
+                }
+                int cls = 0;
+                while ((kMinPooledSize << cls) < size)
+                {
+                    cls++;
+                }
+                return cls;
+            }
+
+            static FreeList* Lists()
+            {
+                thread_local FreeList lists[kNumClasses];
+                return lists;
+            }
+        };
+
+    } // namespace details
+
+    class BadValueCast : public std::exception
+    {
+    public:
+        const char* what() const noexcept override { return "bad reflect::Value cast"; }
+    };
+
+    // A container for a value of any type, like std::any. Values of up to `InlineSize` bytes that
+    // can be moved without throwing are stored inline; bigger ones in blocks of the ValuePool.
+    // Destruction, copies and moves go through a per-type table, so they are correct for any type,
+    // and the address of that table identifies the type without RTTI.
+    template<std::size_t InlineSize>
+    class BasicValue
+    {
+    public:
+        BasicValue() = default;
+
+        template<typename T,
+                 typename D = std::decay_t<T>,
+                 typename   = std::enable_if_t<!std::is_same_v<D, BasicValue>>>
+        BasicValue(T&& val)
+        {
+            Emplace<D>(std::forward<T>(val));
+        }
+
+        BasicValue(const BasicValue& other)
+        {
+            if (other.m_ops != nullptr)
+            {
+                if (other.m_ops->copy == nullptr)
+                {
+                    throw std::logic_error("reflect::Value holds a type that cannot be copied");
+                }
+                other.m_ops->copy(other, *this);
+                m_ops = other.m_ops;
+            }
+        }
+
+        BasicValue(BasicValue&& other) noexcept { MoveFrom(other); }
+
+        BasicValue& operator=(const BasicValue& other)
+        {
+            if (this != &other)
+            {
+                BasicValue tmp {other};
+                Reset();
+                MoveFrom(tmp);
+            }
+            return *this;
+        }
+
+        BasicValue& operator=(BasicValue&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Reset();
+                MoveFrom(other);
+            }
+            return *this;
+        }
+
+        ~BasicValue() { Reset(); }
+
+        bool has_value() const { return m_ops != nullptr; }
+
+        template<typename T>
+        bool Is() const
+        {
+            return m_ops == &kOps<T>;
+        }
+
+        // nullptr if the value is not a `T`.
+        template<typename T>
+        T* TryCast()
+        {
+            return Is<T>() ? static_cast<T*>(data()) : nullptr;
+        }
+
+        template<typename T>
+        const T* TryCast() const
+        {
+            return Is<T>() ? static_cast<const T*>(data()) : nullptr;
+        }
+
+        // The stored object, unchecked; nullptr if empty.
+        void* data() const
+        {
+            if (m_ops == nullptr)
+            {
+                return nullptr;
+            }
+            return m_ops->is_inline ? const_cast<unsigned char*>(m_storage.buffer) : m_storage.pointer;
+        }
+
+        template<typename T, typename... Args>
+        T& Emplace(Args&&... args)
+        {
+            static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+            Reset();
+            T* ptr;
+            if constexpr (kIsInline<T>)
+            {
+                ptr = ::new (static_cast<void*>(m_storage.buffer)) T(std::forward<Args>(args)...);
+            }
+            else
+            {
+                void* block = details::ValuePool::Allocate(sizeof(T));
+                try
+                {
+                    ptr = ::new (block) T(std::forward<Args>(args)...);
+                }
+                catch (...)
+                {
+                    details::ValuePool::Deallocate(block, sizeof(T));
+                    throw;
+                }
+                m_storage.pointer = ptr;
+            }
+            m_ops = &kOps<T>;
+            return *ptr;
+        }
+
+        void Reset()
+        {
+            if (m_ops != nullptr)
+            {
+                m_ops->destroy(*this);
+                m_ops = nullptr;
+            }
+        }
+
+    private:
+        static_assert(InlineSize >= sizeof(void*), "");
+
+        template<typename T>
+        static constexpr bool kIsInline = sizeof(T) <= InlineSize && alignof(T) <= alignof(std::max_align_t) &&
+                                          std::is_nothrow_move_constructible_v<T>;
+
+        union Storage
+        {
+            alignas(std::max_align_t) unsigned char buffer[InlineSize];
+            void* pointer;
+        };
+
+        struct Ops
+        {
+            bool is_inline;
+            void (*destroy)(BasicValue& self);
+            // nullptr for types that cannot be copied.
+            void (*copy)(const BasicValue& from, BasicValue& to);
+            // Leaves `from` without a value; its `m_ops` is left to the caller.
+            void (*move)(BasicValue& from, BasicValue& to) noexcept;
+        };
+
+        template<typename T>
+        static void Destroy(BasicValue& self)
+        {
+            if constexpr (kIsInline<T>)
+            {
+                reinterpret_cast<T*>(self.m_storage.buffer)->~T();
+            }
+            else
+            {
+                static_cast<T*>(self.m_storage.pointer)->~T();
+                details::ValuePool::Deallocate(self.m_storage.pointer, sizeof(T));
+            }
+        }
+
+        template<typename T>
+        static void Copy(const BasicValue& from, BasicValue& to)
+        {
+            if constexpr (kIsInline<T>)
+            {
+                ::new (static_cast<void*>(to.m_storage.buffer)) T(*reinterpret_cast<const T*>(from.m_storage.buffer));
+            }
+            else
+            {
+                void* block = details::ValuePool::Allocate(sizeof(T));
+                try
+                {
+                    to.m_storage.pointer = ::new (block) T(*static_cast<const T*>(from.m_storage.pointer));
+                }
+                catch (...)
+                {
+                    details::ValuePool::Deallocate(block, sizeof(T));
+                    throw;
+                }
+            }
+        }
+
+        template<typename T>
+        static void Move(BasicValue& from, BasicValue& to) noexcept
+        {
+            if constexpr (kIsInline<T>)
+            {
+                T* src = reinterpret_cast<T*>(from.m_storage.buffer);
+                ::new (static_cast<void*>(to.m_storage.buffer)) T(std::move(*src));
+                src->~T();
+            }
+            else
+            {
+                to.m_storage.pointer = from.m_storage.pointer;
+            }
+        }
+
+        template<typename T>
+        static constexpr auto CopyFunction()
+        {
+            if constexpr (std::is_copy_constructible_v<T>)
+            {
+                return &Copy<T>;
+            }
+            else
+            {
+                return static_cast<void (*)(const BasicValue&, BasicValue&)>(nullptr);
+            }
+        }
+
+        template<typename T>
+        static constexpr Ops kOps = {kIsInline<T>, &Destroy<T>, CopyFunction<T>(), &Move<T>};
+
+        void MoveFrom(BasicValue& other) noexcept
+        {
+            if (other.m_ops != nullptr)
+            {
+                other.m_ops->move(other, *this);
+                m_ops       = other.m_ops;
+                other.m_ops = nullptr;
+            }
+        }
+
+        const Ops* m_ops {nullptr};
+        Storage    m_storage;
+    };
+
+    // Room for a std::string, a std::vector or a few scalars.
+    using Value = BasicValue<48>;
+
+    // Like std::any_cast: `T` may be a value type or a reference. Throws BadValueCast if the value
+    // is not a `T`.
+    template<typename T, std::size_t N>
+    T ValueCast(const BasicValue<N>& value)
+    {
+        using U      = std::remove_cv_t<std::remove_reference_t<T>>;
+        const U* ptr = value.template TryCast<U>();
+        if (ptr == nullptr)
+        {
+            throw BadValueCast {};
+        }
+        return static_cast<T>(*ptr);
+    }
+
+    template<typename T, std::size_t N>
+    T ValueCast(BasicValue<N>& value)
+    {
+        using U = std::remove_cv_t<std::remove_reference_t<T>>;
+        U* ptr  = value.template TryCast<U>();
+        if (ptr == nullptr)
+        {
+            throw BadValueCast {};
+        }
+        return static_cast<T>(*ptr);
+    }
+
+    template<typename T, std::size_t N>
+    T ValueCast(BasicValue<N>&& value)
+    {
+        using U = std::remove_cv_t<std::remove_reference_t<T>>;
+        U* ptr  = value.template TryCast<U>();
+        if (ptr == nullptr)
+        {
+            throw BadValueCast {};
+        }
+        return static_cast<T>(std::move(*ptr));
+    }
+
+    // nullptr if the value is not a `T`.
+    template<typename T, std::size_t N>
+    const T* ValueCast(const BasicValue<N>* value) noexcept
+    {
+        return value != nullptr ? value->template TryCast<T>() : nullptr;
+    }
+
+    template<typename T, std::size_t N>
+    T* ValueCast(BasicValue<N>* value) noexcept
+    {
+        return value != nullptr ? value->template TryCast<T>() : nullptr;
+    }
+
+} // namespace reflect
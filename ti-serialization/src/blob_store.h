@@ -0,0 +1,364 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "byte_order.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#ifndef TI_SERIALIZATION_HAS_MMAP
+#define TI_SERIALIZATION_HAS_MMAP
+#endif
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//                       Content-addressed blob storage                       //
+////////////////////////////////////////////////////////////////////////////////
+
+// Identifies a blob by a 128-bit hash of its contents.
+struct BlobId {
+  uint64_t lo{0};
+  uint64_t hi{0};
+
+  bool operator==(const BlobId &other) const {
+    return lo == other.lo && hi == other.hi;
+  }
+};
+
+struct BlobIdHash {
+  std::size_t operator()(const BlobId &id) const {
+    // Already well mixed.
+    return static_cast<std::size_t>(id.lo);
+  }
+};
+
+namespace detail {
+
+inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t fmix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// MurmurHash3_x64_128. Not cryptographic, but fast (several GB/s) and with
+// 128 bits, accidental collisions are not a practical concern.
+inline BlobId hash128(const void *data, std::size_t size, uint64_t seed = 0) {
+  constexpr uint64_t c1 = 0x87c37b91114253d5ULL;
+  constexpr uint64_t c2 = 0x4cf5ad432745937fULL;
+  const auto *p = static_cast<const uint8_t *>(data);
+  uint64_t h1 = seed, h2 = seed;
+  const std::size_t num_blocks = size / 16;
+  for (std::size_t i = 0; i < num_blocks; i++) {
+    uint64_t k1 = load_le<uint64_t>(p + 16 * i);
+    uint64_t k2 = load_le<uint64_t>(p + 16 * i + 8);
+    k1 *= c1;
+    k1 = rotl64(k1, 31);
+    k1 *= c2;
+    h1 ^= k1;
+    h1 = rotl64(h1, 27);
+    h1 += h2;
+    h1 = h1 * 5 + 0x52dce729;
+    k2 *= c2;
+    k2 = rotl64(k2, 33);
+    k2 *= c1;
+    h2 ^= k2;
+    h2 = rotl64(h2, 31);
+    h2 += h1;
+    h2 = h2 * 5 + 0x38495ab5;
+  }
+  const uint8_t *tail = p + 16 * num_blocks;
+  const std::size_t rest = size % 16;
+  uint64_t k1 = 0, k2 = 0;
+  for (std::size_t i = 8; i < rest; i++) {
+    k2 ^= uint64_t(tail[i]) << (8 * (i - 8));
+  }
+  if (rest > 8) {
+    k2 *= c2;
+    k2 = rotl64(k2, 33);
+    k2 *= c1;
+    h2 ^= k2;
+  }
+  for (std::size_t i = 0; i < rest && i < 8; i++) {
+    k1 ^= uint64_t(tail[i]) << (8 * i);
+  }
+  if (rest > 0) {
+    k1 *= c1;
+    k1 = rotl64(k1, 31);
+    k1 *= c2;
+    h1 ^= k1;
+  }
+  h1 ^= size;
+  h2 ^= size;
+  h1 += h2;
+  h2 += h1;
+  h1 = fmix64(h1);
+  h2 = fmix64(h2);
+  h1 += h2;
+  h2 += h1;
+  return {h1, h2};
+}
+
+// How `BinarySerializer` stores a deduplicated blob, after its length:
+//   uint8 tag, BlobId, and for kInline the contents.
+enum class BlobTag : uint8_t {
+  kInline = 0,     // first occurrence in this buffer
+  kReference = 1,  // same contents as an earlier kInline blob
+  kStored = 2,     // contents are in the BlobStore
+};
+
+}  // namespace detail
+
+// An append-only file of blobs keyed by their hash, shared by any number of
+// snapshots so that unchanged payloads are stored once overall. Layout:
+//
+//   kMagic, then per blob: BlobId, uint64 size, contents
+//
+// Contents are read through a mapping of the file. Not thread-safe.
+class BlobStore {
+ public:
+  static constexpr uint64_t kMagic = 0x5453424f4c424954;  // "TIBLOBST"
+
+  // Opens the store, creating it if it does not exist. A truncated last blob
+  // (e.g. from a crash) is dropped and cut from the file.
+  explicit BlobStore(const std::string &fn) : fn_(fn) {
+    file_ = std::fopen(fn.c_str(), "r+b");
+    if (file_ == nullptr) {
+      file_ = std::fopen(fn.c_str(), "w+b");
+      if (file_ == nullptr) {
+        throw std::runtime_error("failed to open");
+      }
+      write_u64(kMagic);
+      size_ = sizeof(kMagic);
+      return;
+    }
+    try {
+      size_ = file_size();
+      map();
+      uint64_t magic = 0;
+      if (size_ >= sizeof(magic)) {
+        magic = detail::load_le<uint64_t>(view_);
+      }
+      if (magic != kMagic) {
+        throw std::runtime_error("not a blob store");
+      }
+      index();
+      if (size_ < mapped_size_) {
+        // Drop the torn tail so that it cannot outlive the blobs written over
+        // it.
+        unmap();
+        truncate();
+        map();
+      }
+    } catch (...) {
+      unmap();
+      std::fclose(file_);
+      throw;
+    }
+  }
+
+  BlobStore(const BlobStore &) = delete;
+  BlobStore &operator=(const BlobStore &) = delete;
+
+  ~BlobStore() {
+    unmap();
+    if (file_ != nullptr) {
+      std::fclose(file_);
+    }
+  }
+
+  std::size_t size() const {
+    return blobs_.size();
+  }
+
+  bool contains(const BlobId &id) const {
+    return blobs_.count(id) != 0;
+  }
+
+  // Adds a blob unless one with the same id is present. Returns whether it
+  // was added.
+  bool put(const BlobId &id, const void *data, std::size_t size) {
+    if (contains(id)) {
+      return false;
+    }
+    seek(size_);
+    write_u64(id.lo);
+    write_u64(id.hi);
+    write_u64(size);
+    write(data, size);
+    blobs_[id] = {size_ + 3 * sizeof(uint64_t), size};
+    size_ += 3 * sizeof(uint64_t) + size;
+    return true;
+  }
+
+  // The contents of blob `id`, valid until the next `put` or `flush`.
+  std::pair<const uint8_t *, std::size_t> get(const BlobId &id) {
+    auto it = blobs_.find(id);
+    if (it == blobs_.end()) {
+      throw std::runtime_error("blob not found in store");
+    }
+    if (it->second.first + it->second.second > mapped_size_) {
+      flush();
+    }
+    return {view_ + it->second.first, it->second.second};
+  }
+
+  // Writes buffered blobs to the file and maps them.
+  void flush() {
+    if (std::fflush(file_) != 0) {
+      throw std::runtime_error("failed to write blob store");
+    }
+    unmap();
+    map();
+  }
+
+ private:
+  void write(const void *data, std::size_t size) {
+    if (std::fwrite(data, 1, size, file_) != size) {
+      throw std::runtime_error("failed to write blob store");
+    }
+  }
+
+  void write_u64(uint64_t val) {
+    val = detail::to_le(val);
+    write(&val, sizeof(val));
+  }
+
+  // `std::fseek` takes a `long`, which is 32 bits on Windows and 32-bit
+  // POSIX, so stores past 2 GB need the 64-bit variants.
+  void seek(std::size_t offset, int whence = SEEK_SET) {
+#if defined(_WIN32)
+    int ret = _fseeki64(file_, static_cast<__int64>(offset), whence);
+#elif defined(TI_SERIALIZATION_HAS_MMAP)
+    int ret = fseeko(file_, static_cast<off_t>(offset), whence);
+#else
+    int ret = std::fseek(file_, static_cast<long>(offset), whence);
+#endif
+    if (ret != 0) {
+      throw std::runtime_error("failed to seek blob store");
+    }
+  }
+
+  std::size_t file_size() {
+    seek(0, SEEK_END);
+#if defined(_WIN32)
+    auto size = _ftelli64(file_);
+#elif defined(TI_SERIALIZATION_HAS_MMAP)
+    auto size = ftello(file_);
+#else
+    auto size = std::ftell(file_);
+#endif
+    if (size < 0) {
+      throw std::runtime_error("failed to seek blob store");
+    }
+    return static_cast<std::size_t>(size);
+  }
+
+  // Cuts the file down to `size_`.
+  void truncate() {
+    if (std::fflush(file_) != 0) {
+      throw std::runtime_error("failed to write blob store");
+    }
+#if defined(_WIN32)
+    int ret = _chsize_s(_fileno(file_), static_cast<__int64>(size_));
+#elif defined(TI_SERIALIZATION_HAS_MMAP)
+    int ret = ftruncate(fileno(file_), static_cast<off_t>(size_));
+#else
+    // No portable way to shrink a file; later blobs overwrite the tail.
+    int ret = 0;
+#endif
+    if (ret != 0) {
+      throw std::runtime_error("failed to truncate blob store");
+    }
+  }
+
+  void map() {
+    mapped_size_ = size_;
+#if defined(TI_SERIALIZATION_HAS_MMAP)
+    if (mapped_size_ == 0) {
+      return;
+    }
+    int fd = ::open(fn_.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("failed to open");
+    }
+    void *mapped = mmap(nullptr, mapped_size_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+      throw std::runtime_error("failed to mmap");
+    }
+    view_ = static_cast<const uint8_t *>(mapped);
+#else
+    buffer_.resize(mapped_size_);
+    seek(0);
+    if (std::fread(buffer_.data(), 1, mapped_size_, file_) != mapped_size_) {
+      throw std::runtime_error("failed to read blob store");
+    }
+    view_ = buffer_.data();
+#endif
+  }
+
+  void unmap() {
+#if defined(TI_SERIALIZATION_HAS_MMAP)
+    if (view_ != nullptr) {
+      munmap(const_cast<uint8_t *>(view_), mapped_size_);
+    }
+#endif
+    view_ = nullptr;
+    mapped_size_ = 0;
+  }
+
+  void index() {
+    std::size_t offset = sizeof(kMagic);
+    while (size_ - offset >= 3 * sizeof(uint64_t)) {
+      uint64_t header[3];
+      for (int i = 0; i < 3; i++) {
+        header[i] = detail::load_le<uint64_t>(view_ + offset + 8 * i);
+      }
+      const std::size_t contents = offset + sizeof(header);
+      if (header[2] > size_ - contents) {
+        break;
+      }
+      blobs_[BlobId{header[0], header[1]}] = {contents, header[2]};
+      offset = contents + header[2];
+    }
+    // Later blobs are appended after the last complete one.
+    size_ = offset;
+  }
+
+  std::string fn_;
+  std::FILE *file_{nullptr};
+  // Bytes of valid blobs in the file.
+  std::size_t size_{0};
+  const uint8_t *view_{nullptr};
+  std::size_t mapped_size_{0};
+#if !defined(TI_SERIALIZATION_HAS_MMAP)
+  std::vector<uint8_t> buffer_;
+#endif
+  // Id -> (offset of the contents, size)
+  std::unordered_map<BlobId, std::pair<std::size_t, std::size_t>, BlobIdHash>
+      blobs_;
+};
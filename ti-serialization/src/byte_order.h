@@ -0,0 +1,166 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//                    Little-endian byte order on the wire                    //
+////////////////////////////////////////////////////////////////////////////////
+
+// Everything `BinarySerializer` writes is little-endian, with 64-bit lengths.
+// On little-endian hosts all of the below is a plain copy, so the common case
+// costs nothing; big-endian hosts swap bytes on the way in and out.
+
+namespace detail {
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && \
+    __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline constexpr bool kLittleEndianHost = false;
+#else
+inline constexpr bool kLittleEndianHost = true;
+#endif
+
+inline uint16_t byteswap16(uint16_t v) {
+#if defined(_MSC_VER)
+  return _byteswap_ushort(v);
+#else
+  return __builtin_bswap16(v);
+#endif
+}
+
+inline uint32_t byteswap32(uint32_t v) {
+#if defined(_MSC_VER)
+  return _byteswap_ulong(v);
+#else
+  return __builtin_bswap32(v);
+#endif
+}
+
+inline uint64_t byteswap64(uint64_t v) {
+#if defined(_MSC_VER)
+  return _byteswap_uint64(v);
+#else
+  return __builtin_bswap64(v);
+#endif
+}
+
+// Reverses the bytes of a scalar (integer, float, enum) of 1, 2, 4 or 8 bytes.
+template <typename T>
+T byteswap(T val) {
+  static_assert(std::is_trivially_copyable_v<T>, "");
+  if constexpr (sizeof(T) == 1) {
+    return val;
+  } else {
+    using U = std::conditional_t<
+        sizeof(T) == 2, uint16_t,
+        std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>;
+    static_assert(sizeof(T) == sizeof(U), "unsupported scalar size");
+    U u;
+    std::memcpy(&u, &val, sizeof(u));
+    if constexpr (sizeof(U) == 2) {
+      u = byteswap16(u);
+    } else if constexpr (sizeof(U) == 4) {
+      u = byteswap32(u);
+    } else {
+      u = byteswap64(u);
+    }
+    std::memcpy(&val, &u, sizeof(u));
+    return val;
+  }
+}
+
+// Host order <-> little-endian; the same operation in both directions.
+template <typename T>
+T to_le(T val) {
+  if constexpr (kLittleEndianHost || sizeof(T) == 1) {
+    return val;
+  } else {
+    return byteswap(val);
+  }
+}
+
+template <typename T>
+void store_le(uint8_t *dst, T val) {
+  val = to_le(val);
+  std::memcpy(dst, &val, sizeof(T));
+}
+
+template <typename T>
+T load_le(const uint8_t *src) {
+  T val;
+  std::memcpy(&val, src, sizeof(T));
+  return to_le(val);
+}
+
+#if defined(__GNUC__)
+
+using Bytes16 = uint8_t __attribute__((vector_size(16)));
+
+// Reverses each `kElemSize`-byte element of 16 bytes with one shuffle (pshufb,
+// vperm, vrev, ...). Byte i comes from i ^ (kElemSize - 1).
+template <std::size_t kElemSize>
+inline void byteswap_block(uint8_t *dst, const uint8_t *src) {
+  Bytes16 v;
+  std::memcpy(&v, src, sizeof(v));
+#if defined(__clang__)
+  if constexpr (kElemSize == 2) {
+    v = __builtin_shufflevector(v, v, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10,
+                                13, 12, 15, 14);
+  } else if constexpr (kElemSize == 4) {
+    v = __builtin_shufflevector(v, v, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8,
+                                15, 14, 13, 12);
+  } else {
+    v = __builtin_shufflevector(v, v, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12,
+                                11, 10, 9, 8);
+  }
+#else
+  constexpr uint8_t m = kElemSize - 1;
+  const Bytes16 mask = {0 ^ m, 1 ^ m, 2 ^ m,  3 ^ m,  4 ^ m,  5 ^ m,
+                        6 ^ m, 7 ^ m, 8 ^ m,  9 ^ m,  10 ^ m, 11 ^ m,
+                        12 ^ m, 13 ^ m, 14 ^ m, 15 ^ m};
+  v = __builtin_shuffle(v, mask);
+#endif
+  std::memcpy(dst, &v, sizeof(v));
+}
+
+#endif
+
+// Copies `n` elements of `kElemSize` bytes, reversing the bytes of each.
+template <std::size_t kElemSize>
+void byteswap_copy(uint8_t *dst, const uint8_t *src, std::size_t n) {
+  static_assert(kElemSize == 2 || kElemSize == 4 || kElemSize == 8, "");
+  std::size_t i = 0;
+#if defined(__GNUC__)
+  for (; i + 16 / kElemSize <= n; i += 16 / kElemSize) {
+    byteswap_block<kElemSize>(dst + kElemSize * i, src + kElemSize * i);
+  }
+#endif
+  for (; i < n; i++) {
+    for (std::size_t b = 0; b < kElemSize; b++) {
+      dst[kElemSize * i + b] = src[kElemSize * i + kElemSize - 1 - b];
+    }
+  }
+}
+
+// Copies `n` scalars of type `T` between host and little-endian order.
+template <typename T>
+void copy_le(void *dst, const void *src, std::size_t n) {
+  if constexpr (kLittleEndianHost || sizeof(T) == 1) {
+    std::memcpy(dst, src, sizeof(T) * n);
+  } else {
+    byteswap_copy<sizeof(T)>(static_cast<uint8_t *>(dst),
+                             static_cast<const uint8_t *>(src), n);
+  }
+}
+
+}  // namespace detail
@@ -0,0 +1,352 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "serialization.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TI_SERIALIZATION_HAS_PWRITE
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//                  Page-cache-bypassing writes of big files                  //
+////////////////////////////////////////////////////////////////////////////////
+
+// Writes a file sequentially with O_DIRECT (F_NOCACHE on macOS), so that
+// checkpoints of any size do not evict the page cache. Data is copied into a
+// small pool of aligned buffers; full buffers are written with `pwrite` by a
+// few I/O threads, so that several writes are in flight while the caller
+// fills the next buffer.
+//
+// Where the file system rejects O_DIRECT, the writer falls back to buffered
+// writes and on Linux drops each written range from the page cache once it
+// reached the disk. Without pwrite (e.g. Windows), it writes through stdio.
+class DirectFileWriter {
+ public:
+  // O_DIRECT needs buffers, offsets and sizes aligned to the logical block
+  // size, which is at most this on common devices.
+  static constexpr std::size_t kAlignment = 4096;
+
+  explicit DirectFileWriter(const std::string &fn,
+                            std::size_t buffer_size = std::size_t(8) << 20,
+                            std::size_t num_threads = 2,
+                            std::size_t num_buffers = 8)
+      : buffer_size_(round_up(std::max<std::size_t>(buffer_size, 1))) {
+#if defined(TI_SERIALIZATION_HAS_PWRITE)
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined(O_DIRECT)
+    fd_ = ::open(fn.c_str(), flags | O_DIRECT, 0644);
+    direct_ = fd_ >= 0;
+    opened_direct_ = direct_;
+#endif
+    if (fd_ < 0) {
+      // E.g. tmpfs.
+      fd_ = ::open(fn.c_str(), flags, 0644);
+    }
+    if (fd_ < 0) {
+      throw std::runtime_error("failed to open");
+    }
+#if defined(__APPLE__)
+    direct_ = fcntl(fd_, F_NOCACHE, 1) != -1;
+#endif
+    num_buffers = std::max(num_buffers, num_threads + 1);
+    for (std::size_t i = 0; i < num_buffers; i++) {
+      void *ptr = nullptr;
+      if (posix_memalign(&ptr, kAlignment, buffer_size_) != 0) {
+        release_resources();
+        throw std::bad_alloc();
+      }
+      pool_.push_back(static_cast<uint8_t *>(ptr));
+      free_.push_back(pool_.back());
+    }
+    for (std::size_t i = 0; i < std::max<std::size_t>(num_threads, 1); i++) {
+      threads_.emplace_back([this] { work(); });
+    }
+#else
+    (void)num_threads;
+    (void)num_buffers;
+    file_ = std::fopen(fn.c_str(), "wb");
+    if (file_ == nullptr) {
+      throw std::runtime_error("failed to open");
+    }
+#endif
+  }
+
+  DirectFileWriter(const DirectFileWriter &) = delete;
+  DirectFileWriter &operator=(const DirectFileWriter &) = delete;
+
+  ~DirectFileWriter() {
+    try {
+      close();
+    } catch (const std::exception &) {
+      // Errors are only reported by an explicit close().
+    }
+  }
+
+  // Whether the page cache is bypassed.
+  bool direct() const {
+    return direct_;
+  }
+
+  // Bytes written so far.
+  std::size_t size() const {
+    return size_;
+  }
+
+  // Appends `size` bytes. Only blocks when all buffers are in flight.
+  void write(const void *data, std::size_t size) {
+    const auto *src = static_cast<const uint8_t *>(data);
+    size_ += size;
+#if defined(TI_SERIALIZATION_HAS_PWRITE)
+    while (size != 0) {
+      if (current_ == nullptr) {
+        current_ = acquire();
+      }
+      const std::size_t n = std::min(size, buffer_size_ - fill_);
+      std::memcpy(current_ + fill_, src, n);
+      fill_ += n;
+      src += n;
+      size -= n;
+      if (fill_ == buffer_size_) {
+        submit(buffer_size_);
+      }
+    }
+#else
+    if (std::fwrite(src, 1, size, file_) != size) {
+      throw std::runtime_error("failed to write");
+    }
+#endif
+  }
+
+  // Writes the rest and waits for all writes. Throws if any of them failed.
+  void close() {
+#if defined(TI_SERIALIZATION_HAS_PWRITE)
+    if (fd_ < 0) {
+      return;
+    }
+    if (current_ != nullptr && !failed()) {
+      // O_DIRECT can only write whole blocks; the padding is cut off below.
+      const std::size_t padded = direct_ ? round_up(fill_) : fill_;
+      std::memset(current_ + fill_, 0, padded - fill_);
+      submit(padded);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    queue_cv_.notify_all();
+    for (auto &thread : threads_) {
+      thread.join();
+    }
+    threads_.clear();
+    if (error_.empty() && ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+      error_ = "failed to truncate";
+    }
+    release_resources();
+    if (!error_.empty()) {
+      throw std::runtime_error(error_);
+    }
+#else
+    if (file_ == nullptr) {
+      return;
+    }
+    const bool failed = std::fclose(file_) != 0;
+    file_ = nullptr;
+    if (failed) {
+      throw std::runtime_error("failed to write");
+    }
+#endif
+  }
+
+ private:
+  static std::size_t round_up(std::size_t size) {
+    return (size + kAlignment - 1) / kAlignment * kAlignment;
+  }
+
+#if defined(TI_SERIALIZATION_HAS_PWRITE)
+  struct Job {
+    uint8_t *buffer;
+    std::size_t size;
+    uint64_t offset;
+  };
+
+  bool failed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !error_.empty();
+  }
+
+  uint8_t *acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    free_cv_.wait(lock, [this] { return !free_.empty() || !error_.empty(); });
+    if (!error_.empty()) {
+      throw std::runtime_error(error_);
+    }
+    uint8_t *buffer = free_.back();
+    free_.pop_back();
+    return buffer;
+  }
+
+  void submit(std::size_t size) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back({current_, size, file_offset_});
+    }
+    queue_cv_.notify_one();
+    file_offset_ += size;
+    current_ = nullptr;
+    fill_ = 0;
+  }
+
+  void work() {
+    while (true) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        queue_cv_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+        if (queue_.empty()) {
+          return;
+        }
+        job = queue_.front();
+        queue_.pop_front();
+      }
+      const char *error = write_at(job);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error != nullptr && error_.empty()) {
+          error_ = error;
+        }
+        free_.push_back(job.buffer);
+      }
+      free_cv_.notify_one();
+    }
+  }
+
+  // Returns an error message, or nullptr.
+  const char *write_at(const Job &job) {
+    std::size_t done = 0;
+#if defined(O_DIRECT)
+    bool retried = false;
+#endif
+    while (done < job.size) {
+      const ssize_t n = pwrite(fd_, job.buffer + done, job.size - done,
+                               static_cast<off_t>(job.offset + done));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+#if defined(O_DIRECT)
+      if (n < 0 && errno == EINVAL && opened_direct_ && !retried) {
+        // Accepted by open() but not supported by the file system. Another
+        // thread may have cleared the flag after this write was issued, so
+        // retry either way, but only once: a second EINVAL is a real error.
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          if (direct_) {
+            fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+            direct_ = false;
+          }
+        }
+        retried = true;
+        continue;
+      }
+#endif
+      if (n <= 0) {
+        return "failed to write";
+      }
+      done += static_cast<std::size_t>(n);
+    }
+#if defined(__linux__)
+    if (!direct_) {
+      // Write the range out and drop it, so it doesn't linger in the cache.
+      sync_file_range(fd_, static_cast<off_t>(job.offset),
+                      static_cast<off_t>(job.size),
+                      SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                          SYNC_FILE_RANGE_WAIT_AFTER);
+      posix_fadvise(fd_, static_cast<off_t>(job.offset),
+                    static_cast<off_t>(job.size), POSIX_FADV_DONTNEED);
+    }
+#endif
+    return nullptr;
+  }
+
+  void release_resources() {
+    for (uint8_t *buffer : pool_) {
+      std::free(buffer);
+    }
+    pool_.clear();
+    free_.clear();
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  int fd_{-1};
+  std::vector<uint8_t *> pool_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable queue_cv_;
+  std::condition_variable free_cv_;
+  // Guarded by `mutex_`.
+  std::vector<uint8_t *> free_;
+  std::deque<Job> queue_;
+  bool stopping_{false};
+  std::string error_;
+  // Only used by the writing thread.
+  uint8_t *current_{nullptr};
+  std::size_t fill_{0};
+  uint64_t file_offset_{0};
+#else
+  std::FILE *file_{nullptr};
+#endif
+  std::size_t buffer_size_;
+  std::size_t size_{0};
+  // Whether the file was opened with O_DIRECT; set before any I/O thread
+  // starts.
+  bool opened_direct_{false};
+  // Cleared by an I/O thread if O_DIRECT turns out not to work.
+  std::atomic<bool> direct_{false};
+};
+
+// Like `write_data_to_file`, but without going through the page cache.
+inline void write_data_to_file_direct(const std::string &fn,
+                                      const uint8_t *data,
+                                      std::size_t size) {
+  DirectFileWriter writer(fn);
+  writer.write(data, size);
+  writer.close();
+}
+
+// Like `write_to_binary_file`, but without going through the page cache.
+//
+// The object is still serialized into memory first: the writer patches bytes
+// it already wrote (the size header, packed bool flag bytes) and compares new
+// blobs with earlier ones, so the output cannot be streamed out as it grows.
+// Peak memory is the serialized size; only the page cache is spared.
+template <typename T>
+void write_to_binary_file_direct(const T &t, const std::string &file_name) {
+  BinaryOutputSerializer writer;
+  writer.initialize();
+  writer(t);
+  writer.finalize();
+  write_data_to_file_direct(file_name, writer.data.data(), writer.head);
+}
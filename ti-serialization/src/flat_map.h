@@ -0,0 +1,193 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//                          Map on a sorted std::vector                       //
+////////////////////////////////////////////////////////////////////////////////
+
+// A map kept as a std::vector of (key, value) pairs sorted by key. Lookups are
+// binary searches over contiguous memory and there is one allocation overall,
+// which beats std::map for maps that are mostly built once and then read.
+// Inserting in the middle is O(n); build big maps with `adopt` instead.
+//
+// Unlike std::map, the keys are not const. Changing one through an iterator
+// breaks the ordering.
+template <typename K, typename V, typename Compare = std::less<K>>
+class FlatMap {
+ public:
+  using key_type = K;
+  using mapped_type = V;
+  using value_type = std::pair<K, V>;
+  using container_type = std::vector<value_type>;
+  using size_type = std::size_t;
+  using iterator = typename container_type::iterator;
+  using const_iterator = typename container_type::const_iterator;
+
+  FlatMap() = default;
+
+  FlatMap(std::initializer_list<value_type> entries) {
+    adopt(container_type(entries));
+  }
+
+  iterator begin() {
+    return entries_.begin();
+  }
+
+  iterator end() {
+    return entries_.end();
+  }
+
+  const_iterator begin() const {
+    return entries_.begin();
+  }
+
+  const_iterator end() const {
+    return entries_.end();
+  }
+
+  size_type size() const {
+    return entries_.size();
+  }
+
+  bool empty() const {
+    return entries_.empty();
+  }
+
+  void clear() {
+    entries_.clear();
+  }
+
+  void reserve(size_type n) {
+    entries_.reserve(n);
+  }
+
+  iterator lower_bound(const K &key) {
+    return std::lower_bound(entries_.begin(), entries_.end(), key, KeyLess());
+  }
+
+  const_iterator lower_bound(const K &key) const {
+    return std::lower_bound(entries_.begin(), entries_.end(), key, KeyLess());
+  }
+
+  iterator find(const K &key) {
+    auto it = lower_bound(key);
+    return (it != end() && !Compare()(key, it->first)) ? it : end();
+  }
+
+  const_iterator find(const K &key) const {
+    auto it = lower_bound(key);
+    return (it != end() && !Compare()(key, it->first)) ? it : end();
+  }
+
+  size_type count(const K &key) const {
+    return find(key) != end() ? 1 : 0;
+  }
+
+  V &at(const K &key) {
+    auto it = find(key);
+    if (it == end()) {
+      throw std::out_of_range("key not found");
+    }
+    return it->second;
+  }
+
+  const V &at(const K &key) const {
+    auto it = find(key);
+    if (it == end()) {
+      throw std::out_of_range("key not found");
+    }
+    return it->second;
+  }
+
+  V &operator[](const K &key) {
+    return try_emplace(key).first->second;
+  }
+
+  // Inserts (key, V(args...)) unless `key` is present. Appending in key order
+  // is amortized O(1).
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const K &key, Args &&...args) {
+    auto it = entries_.empty() || Compare()(entries_.back().first, key)
+                  ? entries_.end()
+                  : lower_bound(key);
+    if (it != entries_.end() && !Compare()(key, it->first)) {
+      return {it, false};
+    }
+    it = entries_.emplace(it, std::piecewise_construct,
+                          std::forward_as_tuple(key),
+                          std::forward_as_tuple(std::forward<Args>(args)...));
+    return {it, true};
+  }
+
+  std::pair<iterator, bool> insert(const value_type &entry) {
+    return try_emplace(entry.first, entry.second);
+  }
+
+  size_type erase(const K &key) {
+    auto it = find(key);
+    if (it == end()) {
+      return 0;
+    }
+    entries_.erase(it);
+    return 1;
+  }
+
+  iterator erase(const_iterator it) {
+    return entries_.erase(it);
+  }
+
+  // Replaces the contents with `entries` in O(n) if they are sorted and
+  // O(n log n) otherwise. Of equal keys, the first one is kept.
+  void adopt(container_type &&entries) {
+    entries_ = std::move(entries);
+    if (!std::is_sorted(entries_.begin(), entries_.end(), EntryLess())) {
+      std::stable_sort(entries_.begin(), entries_.end(), EntryLess());
+    }
+    entries_.erase(std::unique(entries_.begin(), entries_.end(),
+                               [](const value_type &a, const value_type &b) {
+                                 return !Compare()(a.first, b.first);
+                               }),
+                   entries_.end());
+  }
+
+  // Moves the sorted entries out, leaving the map empty.
+  container_type extract() {
+    container_type entries = std::move(entries_);
+    entries_.clear();
+    return entries;
+  }
+
+  bool operator==(const FlatMap &other) const {
+    return entries_ == other.entries_;
+  }
+
+  bool operator!=(const FlatMap &other) const {
+    return entries_ != other.entries_;
+  }
+
+ private:
+  struct KeyLess {
+    bool operator()(const value_type &entry, const K &key) const {
+      return Compare()(entry.first, key);
+    }
+  };
+
+  struct EntryLess {
+    bool operator()(const value_type &a, const value_type &b) const {
+      return Compare()(a.first, b.first);
+    }
+  };
+
+  container_type entries_;
+};
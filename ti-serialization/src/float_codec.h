@@ -0,0 +1,270 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "byte_order.h"
+
+// F16C is used when the build enables it (`-mf16c`, or `/arch:AVX2` on MSVC).
+// Otherwise GCC and Clang on x86 compile it for the F16C functions only and
+// pick it at runtime, so that default builds still get it on CPUs that have it.
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define TI_SERIALIZATION_F16C
+#define TI_SERIALIZATION_HAS_F16C
+#define TI_SERIALIZATION_F16C_TARGET
+#include <immintrin.h>
+#elif (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define TI_SERIALIZATION_F16C
+#define TI_SERIALIZATION_F16C_TARGET __attribute__((target("avx,f16c")))
+#include <immintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//              Lossy encodings for float arrays (fp16, bf16, q8/q16)         //
+////////////////////////////////////////////////////////////////////////////////
+
+// How `BinarySerializer` stores `std::vector<float>`. Everything except
+// `kRaw` is lossy and trades precision for a 2x (fp16, bf16, q16) or 4x (q8)
+// smaller payload.
+enum class FloatArrayEncoding : uint8_t {
+  kRaw = 0,
+  kFp16 = 1,     // IEEE 754 binary16
+  kBf16 = 2,     // bfloat16, i.e. the upper half of a binary32
+  kQuant8 = 3,   // 8-bit fixed point over the array's [min, max]
+  kQuant16 = 4,  // 16-bit fixed point over the array's [min, max]
+};
+
+namespace detail {
+
+// The scalar conversions below are written without data-dependent branches so
+// that compilers can vectorize the loops that call them; they are the fallback
+// when the CPU has no F16C.
+// See https://gist.github.com/rygorous/2156668 for the fp16 tricks.
+
+inline uint32_t float_bits(float f) {
+  uint32_t u;
+  std::memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+inline float bits_float(uint32_t u) {
+  float f;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+// Round-to-nearest-even, NaN is quieted, overflow saturates to Inf.
+inline uint16_t float_to_half_scalar(float f) {
+  constexpr uint32_t kF32Infty = 255u << 23;
+  constexpr uint32_t kF16Max = (127u + 16u) << 23;
+  constexpr uint32_t kDenormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+  uint32_t u = float_bits(f);
+  const uint32_t sign = u & 0x80000000u;
+  u ^= sign;
+
+  const uint32_t inf_nan = (u > kF32Infty) ? 0x7e00u : 0x7c00u;
+  const uint32_t denorm =
+      float_bits(bits_float(u) + bits_float(kDenormMagic)) - kDenormMagic;
+  const uint32_t mant_odd = (u >> 13) & 1u;
+  const uint32_t normal =
+      (u + (uint32_t(15 - 127) << 23) + 0xfffu + mant_odd) >> 13;
+
+  uint32_t o = (u < (113u << 23)) ? denorm : normal;
+  o = (u >= kF16Max) ? inf_nan : o;
+  return static_cast<uint16_t>(o | (sign >> 16));
+}
+
+inline float half_to_float_scalar(uint16_t h) {
+  constexpr uint32_t kShiftedExp = 0x7c00u << 13;
+  const float magic = bits_float(113u << 23);
+
+  uint32_t o = (uint32_t(h) & 0x7fffu) << 13;
+  const uint32_t exp = kShiftedExp & o;
+  o += uint32_t(127 - 15) << 23;
+
+  const uint32_t inf_nan = o + (uint32_t(128 - 16) << 23);
+  const uint32_t denorm = float_bits(bits_float(o + (1u << 23)) - magic);
+  o = (exp == kShiftedExp) ? inf_nan : o;
+  o = (exp == 0) ? denorm : o;
+  return bits_float(o | ((uint32_t(h) & 0x8000u) << 16));
+}
+
+// Round-to-nearest-even, NaN stays NaN.
+inline uint16_t float_to_bf16_scalar(float f) {
+  const uint32_t u = float_bits(f);
+  const uint32_t rounded = (u + 0x7fffu + ((u >> 16) & 1u)) >> 16;
+  const uint32_t nan = (u >> 16) | 0x40u;
+  return static_cast<uint16_t>(((u & 0x7fffffffu) > 0x7f800000u) ? nan
+                                                                  : rounded);
+}
+
+inline float bf16_to_float_scalar(uint16_t h) {
+  return bits_float(uint32_t(h) << 16);
+}
+
+// The packed side of the conversions lives in the serialized stream, which is
+// only byte aligned and little-endian.
+template <typename T>
+T load_unaligned(const uint8_t *src) {
+  return load_le<T>(src);
+}
+
+template <typename T>
+void store_unaligned(uint8_t *dst, T v) {
+  store_le(dst, v);
+}
+
+#if defined(TI_SERIALIZATION_F16C)
+// Convert the largest multiple of 8 elements and return how many that is.
+TI_SERIALIZATION_F16C_TARGET
+inline std::size_t float_to_half_f16c(const float *src,
+                                      uint8_t *dst,
+                                      std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(src + i);
+    __m128i h = _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i), h);
+  }
+  return i;
+}
+
+TI_SERIALIZATION_F16C_TARGET
+inline std::size_t half_to_float_f16c(const uint8_t *src,
+                                      float *dst,
+                                      std::size_t n) {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i h =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+  }
+  return i;
+}
+
+inline bool has_f16c() {
+#if defined(TI_SERIALIZATION_HAS_F16C)
+  return true;
+#else
+  static const bool kHasF16c =
+      __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+  return kHasF16c;
+#endif
+}
+#endif
+
+inline void float_to_half(const float *src, uint8_t *dst, std::size_t n) {
+  std::size_t i = 0;
+#if defined(TI_SERIALIZATION_F16C)
+  if (has_f16c()) {
+    i = float_to_half_f16c(src, dst, n);
+  }
+#endif
+  for (; i < n; i++) {
+    store_unaligned(dst + 2 * i, float_to_half_scalar(src[i]));
+  }
+}
+
+inline void half_to_float(const uint8_t *src, float *dst, std::size_t n) {
+  std::size_t i = 0;
+#if defined(TI_SERIALIZATION_F16C)
+  if (has_f16c()) {
+    i = half_to_float_f16c(src, dst, n);
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = half_to_float_scalar(load_unaligned<uint16_t>(src + 2 * i));
+  }
+}
+
+inline void float_to_bf16(const float *src, uint8_t *dst, std::size_t n) {
+  for (std::size_t i = 0; i < n; i++) {
+    store_unaligned(dst + 2 * i, float_to_bf16_scalar(src[i]));
+  }
+}
+
+inline void bf16_to_float(const uint8_t *src, float *dst, std::size_t n) {
+  for (std::size_t i = 0; i < n; i++) {
+    dst[i] = bf16_to_float_scalar(load_unaligned<uint16_t>(src + 2 * i));
+  }
+}
+
+// Returns the [min, max] of the finite values, or [0, 0] if there are none.
+inline void float_range(const float *src,
+                        std::size_t n,
+                        float &lo,
+                        float &hi) {
+  lo = INFINITY;
+  hi = -INFINITY;
+  for (std::size_t i = 0; i < n; i++) {
+    const bool finite = std::isfinite(src[i]);
+    lo = std::min(lo, finite ? src[i] : lo);
+    hi = std::max(hi, finite ? src[i] : hi);
+  }
+  if (lo > hi) {
+    lo = hi = 0.0f;
+  }
+}
+
+// Maps [lo, hi] onto [0, Q_max] with rounding; non-finite inputs clamp.
+template <typename Q>
+void float_to_quantized(const float *src,
+                        uint8_t *dst,
+                        std::size_t n,
+                        float lo,
+                        float hi) {
+  constexpr float kQMax = float(std::numeric_limits<Q>::max());
+  if (!std::isfinite(hi - lo)) {
+    // Values near both -FLT_MAX and FLT_MAX; their differences need doubles.
+    const double scale = kQMax / (double(hi) - double(lo));
+    for (std::size_t i = 0; i < n; i++) {
+      double q = (double(src[i]) - double(lo)) * scale + 0.5;
+      q = (q > 0.0) ? q : 0.0;
+      q = (q < kQMax) ? q : kQMax;
+      store_unaligned(dst + sizeof(Q) * i, static_cast<Q>(q));
+    }
+    return;
+  }
+  const float scale = (hi > lo) ? kQMax / (hi - lo) : 0.0f;
+  for (std::size_t i = 0; i < n; i++) {
+    float q = (src[i] - lo) * scale + 0.5f;
+    // Written so that NaN ends up as 0.
+    q = (q > 0.0f) ? q : 0.0f;
+    q = (q < kQMax) ? q : kQMax;
+    store_unaligned(dst + sizeof(Q) * i, static_cast<Q>(q));
+  }
+}
+
+template <typename Q>
+void quantized_to_float(const uint8_t *src,
+                        float *dst,
+                        std::size_t n,
+                        float lo,
+                        float hi) {
+  constexpr float kQMax = float(std::numeric_limits<Q>::max());
+  if (!std::isfinite(hi - lo)) {
+    // See `float_to_quantized`.
+    const double step = (double(hi) - double(lo)) / kQMax;
+    for (std::size_t i = 0; i < n; i++) {
+      const double q = load_unaligned<Q>(src + sizeof(Q) * i);
+      dst[i] = float(lo + q * step);
+    }
+    return;
+  }
+  const float step = (hi - lo) / kQMax;
+  for (std::size_t i = 0; i < n; i++) {
+    dst[i] = lo + float(load_unaligned<Q>(src + sizeof(Q) * i)) * step;
+  }
+}
+
+}  // namespace detail
@@ -0,0 +1,269 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "byte_order.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TI_SERIALIZATION_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//              Delta + bit-packing for 32-bit integer arrays                 //
+////////////////////////////////////////////////////////////////////////////////
+
+// How `BinarySerializer` stores `std::vector<int32_t>` and
+// `std::vector<uint32_t>`. `kDeltaBitPacked` suits sorted index lists, CSR
+// offsets and the like; `kAuto` samples each array and only packs it when
+// that is estimated to save at least a quarter of the space.
+enum class IntArrayEncoding : uint8_t {
+  kRaw = 0,
+  kDeltaBitPacked = 1,
+  kAuto = 2,
+};
+
+namespace detail {
+
+// The values are delta coded, and each block of 128 deltas is stored as
+//   int32 min_delta, uint8 bits, 16 * bits bytes of payload
+// where the payload holds `delta - min_delta` using `bits` bits each. The
+// payload layout is "vertical" (as in SIMD-BP128): value i goes to 32-bit
+// lane i % 4, and each lane is packed LSB first on its own, so four values
+// can be unpacked with one SIMD shift and mask. The last block is padded.
+// All arithmetic wraps modulo 2^32, so any input round-trips exactly.
+struct BitPackedBlock {
+  static constexpr std::size_t kSize = 128;
+  static constexpr std::size_t kHeaderBytes = sizeof(int32_t) + 1;
+
+  static std::size_t packed_bytes(uint32_t bits) {
+    return kHeaderBytes + 16 * bits;
+  }
+};
+
+inline uint32_t bits_needed(uint32_t v) {
+  uint32_t bits = 0;
+  while (v != 0) {
+    bits++;
+    v >>= 1;
+  }
+  return bits;
+}
+
+// Computes the frame-of-reference deltas of one block. Returns the number of
+// bits per packed value.
+inline uint32_t block_deltas(const uint32_t *in,
+                             std::size_t n,
+                             uint32_t prev,
+                             uint32_t *deltas,
+                             int32_t &min_delta) {
+  min_delta = INT32_MAX;
+  for (std::size_t i = 0; i < n; i++) {
+    deltas[i] = in[i] - prev;
+    prev = in[i];
+    min_delta = std::min(min_delta, static_cast<int32_t>(deltas[i]));
+  }
+  uint32_t range = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    deltas[i] -= static_cast<uint32_t>(min_delta);
+    range |= deltas[i];
+  }
+  // Padding packs to zero, i.e. decodes to `prev + min_delta`; the decoder
+  // drops it.
+  std::fill(deltas + n, deltas + BitPackedBlock::kSize, 0u);
+  return bits_needed(range);
+}
+
+// The packing of a whole array: the deltas of each block, padded to a full
+// block, with its header. Computed once, then used both for the size of the
+// encoding and for writing it.
+struct DeltaBlocks {
+  std::vector<uint32_t> deltas;
+  std::vector<int32_t> min_deltas;
+  std::vector<uint8_t> bits;
+  // Size of the encoded array.
+  std::size_t packed_size{0};
+};
+
+// Fills `blocks` for the `n` values at `in`; its buffers are reused.
+inline void delta_blocks(const uint32_t *in,
+                         std::size_t n,
+                         DeltaBlocks &blocks) {
+  const std::size_t num_blocks =
+      (n + BitPackedBlock::kSize - 1) / BitPackedBlock::kSize;
+  blocks.deltas.resize(num_blocks * BitPackedBlock::kSize);
+  blocks.min_deltas.resize(num_blocks);
+  blocks.bits.resize(num_blocks);
+  blocks.packed_size = 0;
+  uint32_t prev = 0;
+  for (std::size_t b = 0; b < num_blocks; b++) {
+    const std::size_t i = b * BitPackedBlock::kSize;
+    const std::size_t m = std::min(BitPackedBlock::kSize, n - i);
+    const uint32_t bits = block_deltas(in + i, m, prev, &blocks.deltas[i],
+                                       blocks.min_deltas[b]);
+    blocks.bits[b] = static_cast<uint8_t>(bits);
+    blocks.packed_size += BitPackedBlock::packed_bytes(bits);
+    prev = in[i + m - 1];
+  }
+}
+
+// Estimates whether packing pays off from up to 8 evenly spaced blocks.
+inline bool delta_bitpacking_worthwhile(const uint32_t *in, std::size_t n) {
+  constexpr std::size_t kSampledBlocks = 8;
+  const std::size_t num_blocks =
+      (n + BitPackedBlock::kSize - 1) / BitPackedBlock::kSize;
+  if (num_blocks == 0) {
+    return false;
+  }
+  const std::size_t stride = std::max<std::size_t>(
+      1, num_blocks / kSampledBlocks);
+  uint32_t deltas[BitPackedBlock::kSize];
+  std::size_t raw = 0, packed = 0;
+  for (std::size_t b = 0; b < num_blocks; b += stride) {
+    const std::size_t i = b * BitPackedBlock::kSize;
+    const std::size_t m = std::min(BitPackedBlock::kSize, n - i);
+    int32_t min_delta;
+    packed += BitPackedBlock::packed_bytes(block_deltas(
+        in + i, m, i == 0 ? 0 : in[i - 1], deltas, min_delta));
+    raw += m * sizeof(uint32_t);
+  }
+  return packed * 4 <= raw * 3;
+}
+
+inline void pack_block(const uint32_t *deltas, uint32_t bits, uint8_t *out) {
+  if (bits == 0) {
+    return;
+  }
+  for (std::size_t lane = 0; lane < 4; lane++) {
+    uint64_t acc = 0;
+    uint32_t filled = 0;
+    std::size_t word = 0;
+    for (std::size_t row = 0; row < BitPackedBlock::kSize / 4; row++) {
+      acc |= uint64_t(deltas[row * 4 + lane]) << filled;
+      filled += bits;
+      if (filled >= 32) {
+        const uint32_t w = static_cast<uint32_t>(acc);
+        store_le(out + (word * 4 + lane) * 4, w);
+        word++;
+        acc >>= 32;
+        filled -= 32;
+      }
+    }
+  }
+}
+
+// Writes `blocks` to `out`, which must hold `blocks.packed_size` bytes.
+inline void delta_bitpack(const DeltaBlocks &blocks, uint8_t *out) {
+  for (std::size_t b = 0; b < blocks.bits.size(); b++) {
+    const uint32_t bits = blocks.bits[b];
+    store_le(out, blocks.min_deltas[b]);
+    out[sizeof(int32_t)] = static_cast<uint8_t>(bits);
+    out += BitPackedBlock::kHeaderBytes;
+    pack_block(&blocks.deltas[b * BitPackedBlock::kSize], bits, out);
+    out += 16 * bits;
+  }
+}
+
+#if defined(TI_SERIALIZATION_HAS_SSE2)
+
+// Unpacks 128 values and undoes the deltas, four at a time.
+inline void unpack_block(const uint8_t *in,
+                         uint32_t bits,
+                         uint32_t min_delta,
+                         uint32_t prev,
+                         uint32_t *out) {
+  const __m128i mask = _mm_set1_epi32(
+      bits == 32 ? -1 : static_cast<int32_t>((1u << bits) - 1));
+  const __m128i vmin = _mm_set1_epi32(static_cast<int32_t>(min_delta));
+  __m128i vprev = _mm_set1_epi32(static_cast<int32_t>(prev));
+  const __m128i *src = reinterpret_cast<const __m128i *>(in);
+  __m128i cur = bits ? _mm_loadu_si128(src++) : _mm_setzero_si128();
+  uint32_t shift = 0;
+  for (std::size_t row = 0; row < BitPackedBlock::kSize / 4; row++) {
+    __m128i v = _mm_srl_epi32(cur, _mm_cvtsi32_si128(int(shift)));
+    shift += bits;
+    if (shift >= 32 && row + 1 < BitPackedBlock::kSize / 4) {
+      cur = _mm_loadu_si128(src++);
+      shift -= 32;
+      if (shift) {
+        v = _mm_or_si128(
+            v, _mm_sll_epi32(cur, _mm_cvtsi32_si128(int(bits - shift))));
+      }
+    }
+    v = _mm_add_epi32(_mm_and_si128(v, mask), vmin);
+    // Inclusive prefix sum of the four deltas, carried over from the last row.
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi32(v, vprev);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + row * 4), v);
+    vprev = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+}
+
+#else
+
+inline void unpack_block(const uint8_t *in,
+                         uint32_t bits,
+                         uint32_t min_delta,
+                         uint32_t prev,
+                         uint32_t *out) {
+  const uint64_t mask = (uint64_t(1) << bits) - 1;
+  uint32_t deltas[BitPackedBlock::kSize] = {};
+  for (std::size_t lane = 0; bits && lane < 4; lane++) {
+    uint64_t acc = 0;
+    uint32_t filled = 0;
+    std::size_t word = 0;
+    for (std::size_t row = 0; row < BitPackedBlock::kSize / 4; row++) {
+      if (filled < bits) {
+        const uint32_t w = load_le<uint32_t>(in + (word * 4 + lane) * 4);
+        acc |= uint64_t(w) << filled;
+        filled += 32;
+        word++;
+      }
+      deltas[row * 4 + lane] = static_cast<uint32_t>(acc & mask);
+      acc >>= bits;
+      filled -= bits;
+    }
+  }
+  for (std::size_t i = 0; i < BitPackedBlock::kSize; i++) {
+    prev += deltas[i] + min_delta;
+    out[i] = prev;
+  }
+}
+
+#endif
+
+// Reads `n` values from `in`. Returns the number of bytes consumed.
+inline std::size_t delta_bitunpack(const uint8_t *in,
+                                   std::size_t n,
+                                   uint32_t *out) {
+  const uint8_t *begin = in;
+  uint32_t block[BitPackedBlock::kSize];
+  uint32_t prev = 0;
+  for (std::size_t i = 0; i < n; i += BitPackedBlock::kSize) {
+    const std::size_t m = std::min(BitPackedBlock::kSize, n - i);
+    const int32_t min_delta = load_le<int32_t>(in);
+    const uint32_t bits = in[sizeof(min_delta)];
+    in += BitPackedBlock::kHeaderBytes;
+    // Full blocks are decoded in place, the tail goes through `block`.
+    uint32_t *dst = (m == BitPackedBlock::kSize) ? out + i : block;
+    unpack_block(in, bits, static_cast<uint32_t>(min_delta), prev, dst);
+    if (dst == block) {
+      std::memcpy(out + i, block, m * sizeof(uint32_t));
+    }
+    in += 16 * bits;
+    prev = out[i + m - 1];
+  }
+  return in - begin;
+}
+
+}  // namespace detail
@@ -0,0 +1,112 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#ifndef TI_SERIALIZATION_HAS_SSE2
+#define TI_SERIALIZATION_HAS_SSE2
+#endif
+#include <emmintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//                            JSON string escaping                            //
+////////////////////////////////////////////////////////////////////////////////
+
+namespace detail {
+
+inline bool json_needs_escape(unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+inline void append_json_escape(std::string &out, unsigned char c) {
+  static const char kHex[] = "0123456789abcdef";
+  switch (c) {
+    case '"':
+      out += "\\\"";
+      return;
+    case '\\':
+      out += "\\\\";
+      return;
+    case '\n':
+      out += "\\n";
+      return;
+    case '\r':
+      out += "\\r";
+      return;
+    case '\t':
+      out += "\\t";
+      return;
+    case '\b':
+      out += "\\b";
+      return;
+    case '\f':
+      out += "\\f";
+      return;
+  }
+  const char escaped[] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 15]};
+  out.append(escaped, sizeof(escaped));
+}
+
+// Offset of the first character in [begin, end) that needs escaping, or
+// `end - begin`. Checks 16 bytes per step where SSE2 is available.
+inline std::size_t find_json_escape(const char *begin, const char *end) {
+  const char *p = begin;
+#if defined(TI_SERIALIZATION_HAS_SSE2)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control_max = _mm_set1_epi8(0x1f);
+  for (; end - p >= 16; p += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    // Unsigned v <= 0x1f, i.e. saturating v - 0x1f is zero.
+    const __m128i control =
+        _mm_cmpeq_epi8(_mm_subs_epu8(v, control_max), _mm_setzero_si128());
+    const __m128i special = _mm_or_si128(
+        control, _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                              _mm_cmpeq_epi8(v, backslash)));
+    const int mask = _mm_movemask_epi8(special);
+    if (mask != 0) {
+      int first = 0;
+      while (((mask >> first) & 1) == 0) {
+        first++;
+      }
+      return (p - begin) + first;
+    }
+  }
+#endif
+  for (; p != end; p++) {
+    if (json_needs_escape(static_cast<unsigned char>(*p))) {
+      break;
+    }
+  }
+  return p - begin;
+}
+
+// Appends `str` as a quoted JSON string. Runs that need no escaping, i.e.
+// usually the whole string, are appended in bulk.
+inline void append_json_string(std::string &out, std::string_view str) {
+  out.reserve(out.size() + str.size() + 2);
+  out += '"';
+  const char *p = str.data();
+  const char *end = p + str.size();
+  while (p != end) {
+    const std::size_t run = find_json_escape(p, end);
+    out.append(p, run);
+    p += run;
+    if (p != end) {
+      append_json_escape(out, static_cast<unsigned char>(*p));
+      p++;
+    }
+  }
+  out += '"';
+}
+
+}  // namespace detail
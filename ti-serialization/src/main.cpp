@@ -1,7 +1,18 @@
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <set>
 #include <string>
 #include <vector>
 
+#include "direct_io.h"
+#include "mapped_file.h"
+#include "record_log.h"
+#include "schema_decoder.h"
 #include "serialization.h"
 
 enum class MyBool {
@@ -44,6 +55,489 @@ class Foo {
   TI_IO_DEF(str, x, vec_, flag_);  // no `y_`
 };
 
+struct Particles {
+  std::vector<float> x;
+  std::vector<float> v;
+
+  TI_IO_DEF(x, v);
+};
+
+void DemoFloatArrayEncoding() {
+  Particles particles;
+  for (int i = 0; i < 1000; i++) {
+    particles.x.push_back(0.001f * i);
+    particles.v.push_back(-0.5f * i);
+  }
+
+  for (auto encoding : {FloatArrayEncoding::kRaw, FloatArrayEncoding::kFp16,
+                        FloatArrayEncoding::kQuant8}) {
+    BinaryOutputSerializer bin_output;
+    bin_output.options.float_array_encoding = encoding;
+    bin_output.initialize();
+    bin_output(particles);
+    bin_output.finalize();
+
+    Particles deser_particles;
+    BinaryInputSerializer bin_input;
+    bin_input.options.float_array_encoding = encoding;
+    bin_input.initialize(bin_output.data.data());
+    bin_input(deser_particles);
+    bin_input.finalize();
+
+    std::cout << "float encoding " << int(encoding) << ": " << bin_output.head
+              << " bytes, x[500]=" << deser_particles.x[500] << std::endl;
+  }
+}
+
+void DemoProfiling() {
+  Particles particles;
+  particles.x.assign(1000, 1.0f);
+  particles.v.assign(500, -1.0f);
+
+  SerializationProfiler::reset();
+  BinarySerializer<true, ThreadLocalProfiling> bin_output;
+  bin_output.initialize();
+  bin_output(particles);
+  bin_output.finalize();
+
+  Particles deser_particles;
+  BinarySerializer<false, ThreadLocalProfiling> bin_input;
+  bin_input.initialize(bin_output.data.data());
+  bin_input(deser_particles);
+  bin_input.finalize();
+
+  // Timings vary from run to run; calls and bytes do not.
+  uint64_t x_calls = 0;
+  uint64_t x_bytes = 0;
+  for (const auto &entry : SerializationProfiler::report().paths) {
+    if (entry.name == "x") {
+      x_calls = entry.counter.calls;
+      x_bytes = entry.counter.bytes;
+    }
+  }
+  std::cout << "profiled x: " << x_calls << " calls, " << x_bytes
+            << " bytes, round trip: "
+            << (deser_particles.x == particles.x &&
+                deser_particles.v == particles.v)
+            << std::endl;
+
+  // Without a policy, nothing is recorded.
+  SerializationProfiler::reset();
+  BinaryOutputSerializer plain_output;
+  plain_output.initialize();
+  plain_output(particles);
+  plain_output.finalize();
+  std::cout << "unprofiled: "
+            << SerializationProfiler::report().paths.empty()
+            << ", same bytes: "
+            << (plain_output.head == bin_output.head &&
+                std::equal(plain_output.data.begin(),
+                           plain_output.data.begin() + plain_output.head,
+                           bin_output.data.begin()))
+            << std::endl;
+}
+
+struct Header {
+  uint16_t version{0x0102};
+  int32_t offset{-2};
+  std::string tag{"ab"};
+  std::vector<uint32_t> ids{0x0a0b0c0d};
+
+  bool operator==(const Header &other) const {
+    return version == other.version && offset == other.offset &&
+           tag == other.tag && ids == other.ids;
+  }
+
+  TI_IO_DEF(version, offset, tag, ids);
+};
+
+void DemoByteLayout() {
+  // The same on every host: little-endian, with 64-bit sizes and lengths.
+  const std::vector<uint8_t> golden = {
+      0x24, 0, 0, 0, 0, 0, 0, 0,     // payload size
+      0x02, 0x01,                    // version
+      0xfe, 0xff, 0xff, 0xff,        // offset
+      0x02, 0, 0, 0, 0, 0, 0, 0,     // tag length
+      'a', 'b',                      // tag
+      0x01, 0, 0, 0, 0, 0, 0, 0,     // ids length
+      0x0d, 0x0c, 0x0b, 0x0a,        // ids[0]
+  };
+
+  Header header;
+  BinaryOutputSerializer bin_output;
+  bin_output.initialize();
+  bin_output(header);
+  bin_output.finalize();
+
+  Header deser_header{0, 0, "", {}};
+  BinaryInputSerializer bin_input;
+  bin_input.initialize(const_cast<uint8_t *>(golden.data()));
+  bin_input(deser_header);
+  bin_input.finalize();
+
+  std::cout << "byte layout matches: "
+            << (bin_output.head == golden.size() &&
+                std::equal(golden.begin(), golden.end(),
+                           bin_output.data.begin()))
+            << ", read back: " << (deser_header == header) << std::endl;
+}
+
+struct Settings {
+  bool enabled{true};
+  bool verbose{false};
+  float gain{std::numeric_limits<float>::infinity()};
+  std::optional<int> limit;
+  std::vector<float> samples{1.5f, std::nanf("")};
+
+  TI_IO_DEF(enabled, verbose, gain, limit, samples);
+};
+
+void DemoCompactText() {
+  Settings settings;
+  const std::string compact =
+      TextSerializer::serialize("settings", settings, /*compact=*/true);
+  std::cout << "compact text: " << compact << std::endl;
+
+  // Apart from the whitespace, the indented form is the same.
+  std::string indented = TextSerializer::serialize("settings", settings);
+  indented.erase(std::remove_if(indented.begin(), indented.end(),
+                                [](char c) { return c == ' ' || c == '\n'; }),
+                 indented.end());
+  std::cout << "compact text matches: "
+            << (compact ==
+                "\"settings\":{\"enabled\":true,\"verbose\":false,"
+                "\"gain\":null,\"limit\":{\"has_value\":false},"
+                "\"samples\":[1.5,null]}")
+            << ", same as indented: " << (compact == indented) << std::endl;
+}
+
+struct Visibility {
+  bool shadows{true};
+  bool culled{false};
+  std::optional<int> layer;
+  std::optional<bool> selected{false};
+  std::vector<bool> mask;
+
+  bool operator==(const Visibility &other) const {
+    return shadows == other.shadows && culled == other.culled &&
+           layer == other.layer && selected == other.selected &&
+           mask == other.mask;
+  }
+
+  TI_IO_DEF(shadows, culled, layer, selected, mask);
+};
+
+void DemoPackedBools() {
+  std::vector<Visibility> objects(100);
+  for (int i = 0; i < 100; i++) {
+    objects[i].culled = i % 3 == 0;
+    if (i % 2 == 0) {
+      objects[i].layer = i;
+    }
+    for (int j = 0; j < i % 20; j++) {
+      objects[i].mask.push_back((i + j) % 3 == 0);
+    }
+  }
+
+  for (bool pack_bools : {false, true}) {
+    BinaryOutputSerializer bin_output;
+    bin_output.options.pack_bools = pack_bools;
+    bin_output.initialize();
+    bin_output(objects);
+    bin_output.finalize();
+
+    std::vector<Visibility> deser_objects;
+    BinaryInputSerializer bin_input;
+    bin_input.options.pack_bools = pack_bools;
+    bin_input.initialize(bin_output.data.data());
+    bin_input(deser_objects);
+    bin_input.finalize();
+
+    std::cout << "pack_bools " << pack_bools << ": " << bin_output.head
+              << " bytes, round trip: " << (deser_objects == objects)
+              << std::endl;
+  }
+}
+
+struct SparseRows {
+  std::vector<int32_t> offsets;
+  std::vector<uint32_t> indices;
+
+  TI_IO_DEF(offsets, indices);
+};
+
+void DemoIntArrayEncoding() {
+  SparseRows rows;
+  for (int i = 0; i < 1000; i++) {
+    rows.offsets.push_back(3 * i + i % 2);
+    rows.indices.push_back(uint32_t(i * 7919) % 1000);
+  }
+
+  for (auto encoding : {IntArrayEncoding::kRaw,
+                        IntArrayEncoding::kDeltaBitPacked,
+                        IntArrayEncoding::kAuto}) {
+    BinaryOutputSerializer bin_output;
+    bin_output.options.int_array_encoding = encoding;
+    bin_output.initialize();
+    bin_output(rows);
+    bin_output.finalize();
+
+    SparseRows deser_rows;
+    BinaryInputSerializer bin_input;
+    bin_input.options.int_array_encoding = encoding;
+    bin_input.initialize(bin_output.data.data());
+    bin_input(deser_rows);
+    bin_input.finalize();
+
+    std::cout << "int encoding " << int(encoding) << ": " << bin_output.head
+              << " bytes, round trip: "
+              << (deser_rows.offsets == rows.offsets &&
+                  deser_rows.indices == rows.indices)
+              << std::endl;
+  }
+}
+
+void DemoEmbeddedSchema(const Foo &foo) {
+  BinaryOutputSerializer bin_output;
+  bin_output.options.embed_schema = true;
+  bin_output.initialize();
+  bin_output(foo);
+  bin_output.finalize();
+
+  // Decoding needs neither `Foo` nor its `io()`.
+  SchemaDecoder decoder(bin_output.data.data(), bin_output.head);
+  std::cout << "decoded: " << decoder.to_json() << std::endl;
+  std::cout << "decoded vec_: " << decoder.to_json("vec_") << std::endl;
+
+  // Keyed top-level values get a schema root too.
+  BinaryOutputSerializer keyed_output;
+  keyed_output.options.embed_schema = true;
+  keyed_output.initialize();
+  keyed_output("x", foo.x);
+  keyed_output("foo", foo);
+  keyed_output.finalize();
+  SchemaDecoder keyed_decoder(keyed_output.data.data(), keyed_output.head);
+  std::cout << "decoded keyed: " << keyed_decoder.to_json() << std::endl;
+
+  // Sets are never deduplicated, unlike vectors of the same size.
+  std::vector<int> ids(100);
+  std::string ids_json = "[";
+  for (int i = 0; i < 100; i++) {
+    ids[i] = i;
+    ids_json += (i == 0 ? "" : ",") + std::to_string(i);
+  }
+  ids_json += "]";
+  BinaryOutputSerializer set_output;
+  set_output.options.embed_schema = true;
+  set_output.options.dedup_min_bytes = 64;
+  set_output.initialize();
+  set_output("set", std::set<int>(ids.begin(), ids.end()));
+  set_output("vec", ids);
+  set_output.finalize();
+  SchemaDecoder set_decoder(set_output.data.data(), set_output.head);
+  std::cout << "decoded set and vec: "
+            << (set_decoder.to_json() == "[" + ids_json + "," + ids_json + "]")
+            << std::endl;
+}
+
+struct Checkpoint {
+  int step{0};
+  std::string mesh;
+  std::vector<float> rest_positions;
+  std::vector<float> initial_positions;
+
+  bool operator==(const Checkpoint &other) const {
+    return step == other.step && mesh == other.mesh &&
+           rest_positions == other.rest_positions &&
+           initial_positions == other.initial_positions;
+  }
+
+  TI_IO_DEF(step, mesh, rest_positions, initial_positions);
+};
+
+void DemoDedup() {
+  Checkpoint checkpoint;
+  checkpoint.mesh = std::string(200, 'm');
+  for (int i = 0; i < 1000; i++) {
+    checkpoint.rest_positions.push_back(0.01f * i);
+  }
+  checkpoint.initial_positions = checkpoint.rest_positions;
+
+  // Within a buffer, the second copy of the positions is a reference.
+  for (std::size_t dedup_min_bytes : {0, 64}) {
+    BinaryOutputSerializer bin_output;
+    bin_output.options.dedup_min_bytes = dedup_min_bytes;
+    bin_output.initialize();
+    bin_output(checkpoint);
+    bin_output.finalize();
+
+    Checkpoint deser_checkpoint;
+    BinaryInputSerializer bin_input;
+    bin_input.options.dedup_min_bytes = dedup_min_bytes;
+    bin_input.initialize(bin_output.data.data());
+    bin_input(deser_checkpoint);
+    bin_input.finalize();
+
+    std::cout << "dedup_min_bytes " << dedup_min_bytes << ": "
+              << bin_output.head
+              << " bytes, round trip: " << (deser_checkpoint == checkpoint)
+              << std::endl;
+  }
+
+  // Across buffers, only what changed is added to the store.
+  const std::string fn =
+      (std::filesystem::temp_directory_path() / "ti_demo.blobs").string();
+  std::filesystem::remove(fn);
+  std::vector<std::vector<uint8_t>> snapshots;
+  std::vector<std::size_t> blob_counts;
+  {
+    BlobStore store(fn);
+    for (int step = 0; step < 3; step++) {
+      checkpoint.step = step;
+      checkpoint.rest_positions[0] = step == 2 ? -1.0f : 0.0f;
+      BinaryOutputSerializer bin_output;
+      bin_output.options.dedup_min_bytes = 64;
+      bin_output.options.blob_store = &store;
+      bin_output.initialize();
+      bin_output(checkpoint);
+      bin_output.finalize();
+      snapshots.emplace_back(bin_output.data.begin(),
+                             bin_output.data.begin() + bin_output.head);
+      blob_counts.push_back(store.size());
+    }
+    store.flush();
+  }
+
+  // Reopened, as a later run would.
+  BlobStore store(fn);
+  Checkpoint deser_checkpoint;
+  BinaryInputSerializer bin_input;
+  bin_input.options.dedup_min_bytes = 64;
+  bin_input.options.blob_store = &store;
+  bin_input.initialize(snapshots.back().data());
+  bin_input(deser_checkpoint);
+  bin_input.finalize();
+  std::cout << "blob store: " << snapshots.back().size()
+            << " bytes per snapshot, blobs after each: " << blob_counts[0]
+            << " " << blob_counts[1] << " " << blob_counts[2]
+            << ", round trip: " << (deser_checkpoint == checkpoint)
+            << std::endl;
+  std::filesystem::remove(fn);
+}
+
+void DemoFlatMap() {
+  FlatMap<int, std::string> names;
+  std::map<int, std::string> names_map;
+  std::vector<std::pair<int, std::string>> entries;
+  for (int i = 0; i < 1000; i++) {
+    entries.emplace_back(i * 7 % 1000, "name" + std::to_string(i));
+    names_map.insert(entries.back());
+  }
+  names.adopt(std::move(entries));
+
+  BinaryOutputSerializer bin_output;
+  bin_output.initialize();
+  bin_output(names);
+  bin_output.finalize();
+
+  // Read into a map that already holds as many entries: its vector is
+  // extracted, refilled and adopted back without reallocating.
+  FlatMap<int, std::string> deser_names;
+  for (int i = 0; i < 1000; i++) {
+    deser_names[-i] = "stale";
+  }
+  const auto *storage = &*deser_names.begin();
+  BinaryInputSerializer bin_input;
+  bin_input.initialize(bin_output.data.data());
+  bin_input(deser_names);
+  bin_input.finalize();
+
+  // The same bytes as a std::map, so the two can read each other's output.
+  BinaryOutputSerializer map_output;
+  map_output.initialize();
+  map_output(names_map);
+  map_output.finalize();
+
+  std::cout << "flat map: " << bin_output.head
+            << " bytes, round trip: " << (deser_names == names)
+            << ", reused storage: " << (&*deser_names.begin() == storage)
+            << ", same as std::map: "
+            << (map_output.head == bin_output.head &&
+                std::equal(map_output.data.begin(),
+                           map_output.data.begin() + map_output.head,
+                           bin_output.data.begin()))
+            << std::endl;
+}
+
+void DemoDirectWrite() {
+  Particles particles;
+  for (int i = 0; i < 100000; i++) {
+    particles.x.push_back(0.5f * i);
+  }
+  const std::string fn =
+      (std::filesystem::temp_directory_path() / "ti_demo_direct.bin").string();
+  write_to_binary_file_direct(particles, fn);
+
+  Particles deser_particles;
+  read_from_binary_file(deser_particles, fn);
+  std::cout << "direct write: " << std::filesystem::file_size(fn)
+            << " bytes, round trip: "
+            << (deser_particles.x == particles.x &&
+                deser_particles.v == particles.v)
+            << std::endl;
+  std::filesystem::remove(fn);
+}
+
+void DemoMappedWrite(const Foo &foo) {
+  std::vector<Foo> foos(1000, foo);
+  const std::string fn =
+      (std::filesystem::temp_directory_path() / "ti_demo_mapped.bin").string();
+  for (bool async_flush : {false, true}) {
+    write_to_binary_file_mapped(foos, fn, {}, async_flush);
+
+    std::vector<Foo> deser_foos;
+    read_from_binary_file(deser_foos, fn);
+    bool equal = deser_foos.size() == foos.size();
+    for (std::size_t i = 0; equal && i < foos.size(); i++) {
+      equal = deser_foos[i].EqualsExcludingY(foos[i]);
+    }
+    std::cout << "mapped write, async_flush " << async_flush << ": "
+              << std::filesystem::file_size(fn) << " bytes, expected "
+              << serialized_size(foos) << ", round trip: " << equal
+              << std::endl;
+  }
+  std::filesystem::remove(fn);
+}
+
+void DemoRecordLog(const Foo &foo) {
+  const std::string fn =
+      (std::filesystem::temp_directory_path() / "ti_demo.log").string();
+  {
+    RecordLogWriter writer(fn, /*index_interval=*/4);
+    for (int i = 0; i < 10; i++) {
+      Foo record = foo;
+      record.x = i;
+      writer.append(record);
+    }
+  }
+  {
+    // Continues the log, re-indexing the last partial chunk.
+    RecordLogWriter writer(fn, 4, {}, RecordLogWriter::Mode::kAppend);
+    for (int i = 10; i < 15; i++) {
+      Foo record = foo;
+      record.x = i;
+      writer.append(record);
+    }
+  }
+
+  RecordLogReader reader(fn);
+  Foo record;
+  reader.read(12, record);
+  std::cout << "record log: " << reader.size() << " records, record 12 has x="
+            << record.x << std::endl;
+  std::filesystem::remove(fn);
+}
+
 int main() {
   Foo foo{};
   foo.str = "taichi";
@@ -74,6 +568,19 @@ int main() {
   TextSerializer tex_ser;
   tex_ser("foo", foo);
   tex_ser.print();
+  DemoCompactText();
+
+  DemoByteLayout();
+  DemoFloatArrayEncoding();
+  DemoProfiling();
+  DemoPackedBools();
+  DemoIntArrayEncoding();
+  DemoEmbeddedSchema(foo);
+  DemoDedup();
+  DemoFlatMap();
+  DemoDirectWrite();
+  DemoMappedWrite(foo);
+  DemoRecordLog(foo);
 
   return 0;
 }
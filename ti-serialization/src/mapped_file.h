@@ -0,0 +1,167 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "serialization.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#ifndef TI_SERIALIZATION_HAS_MMAP
+#define TI_SERIALIZATION_HAS_MMAP
+#endif
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//                   Serializing straight into a file mapping                 //
+////////////////////////////////////////////////////////////////////////////////
+
+// A file of a given size, mapped writable, as the buffer of a preserved-mode
+// `BinaryOutputSerializer`. The serializer's stores go to the page cache
+// directly; there is no staging buffer and no copy into the file afterwards.
+//
+//   MappedOutputFile file(fn, serialized_size(t));
+//   writer.initialize(file.data(), file.size());
+//   ...
+//   file.close(writer.head);
+//
+// Where mmap is not available, the file is written from a std::vector.
+class MappedOutputFile {
+ public:
+  MappedOutputFile(const std::string &fn, std::size_t size) : size_(size) {
+#if defined(TI_SERIALIZATION_HAS_MMAP)
+    fd_ = ::open(fn.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+      throw std::runtime_error("failed to open");
+    }
+    if (size_ != 0) {
+      // Allocates nothing yet; pages are backed as they are written.
+      if (ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+        ::close(fd_);
+        throw std::runtime_error("failed to resize");
+      }
+      void *mapped =
+          mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+      if (mapped == MAP_FAILED) {
+        ::close(fd_);
+        throw std::runtime_error("failed to mmap");
+      }
+      data_ = static_cast<uint8_t *>(mapped);
+    }
+#else
+    file_ = std::fopen(fn.c_str(), "wb");
+    if (file_ == nullptr) {
+      throw std::runtime_error("failed to open");
+    }
+    buffer_.resize(size_);
+    data_ = buffer_.data();
+#endif
+  }
+
+  MappedOutputFile(const MappedOutputFile &) = delete;
+  MappedOutputFile &operator=(const MappedOutputFile &) = delete;
+
+  ~MappedOutputFile() {
+    try {
+      close(size_);
+    } catch (const std::exception &) {
+      // Errors are only reported by an explicit close().
+    }
+  }
+
+  uint8_t *data() {
+    return data_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+  // Starts writing the mapping back to the file. With `async`, returns right
+  // away and the kernel writes the pages in the background; otherwise waits
+  // until they are on disk.
+  void flush(bool async = false) {
+#if defined(TI_SERIALIZATION_HAS_MMAP)
+    if (data_ != nullptr &&
+        msync(data_, size_, async ? MS_ASYNC : MS_SYNC) != 0) {
+      throw std::runtime_error("failed to flush");
+    }
+#else
+    (void)async;
+#endif
+  }
+
+  // Flushes, unmaps and cuts the file to its first `used` bytes, e.g. the
+  // final `head` of the serializer. The data is in the file either way; an
+  // `async` flush only leaves writing it to disk to the kernel.
+  void close(std::size_t used, bool async = false) {
+#if defined(TI_SERIALIZATION_HAS_MMAP)
+    if (fd_ < 0) {
+      return;
+    }
+    bool failed = false;
+    if (data_ != nullptr) {
+      failed = msync(data_, size_, async ? MS_ASYNC : MS_SYNC) != 0;
+      munmap(data_, size_);
+      data_ = nullptr;
+    }
+    if (used < size_) {
+      failed = ftruncate(fd_, static_cast<off_t>(used)) != 0 || failed;
+    }
+    failed = ::close(fd_) != 0 || failed;
+    fd_ = -1;
+#else
+    (void)async;
+    if (file_ == nullptr) {
+      return;
+    }
+    used = std::min(used, size_);
+    bool failed = std::fwrite(data_, 1, used, file_) != used;
+    failed = std::fclose(file_) != 0 || failed;
+    file_ = nullptr;
+    data_ = nullptr;
+#endif
+    if (failed) {
+      throw std::runtime_error("failed to write");
+    }
+  }
+
+ private:
+  std::size_t size_;
+  uint8_t *data_{nullptr};
+#if defined(TI_SERIALIZATION_HAS_MMAP)
+  int fd_{-1};
+#else
+  std::FILE *file_{nullptr};
+  std::vector<uint8_t> buffer_;
+#endif
+};
+
+// Like `write_to_binary_file`, but sizes the file with a counting pass and
+// serializes straight into its mapping. With `async_flush`, returns before
+// the data is on disk.
+template <typename T>
+void write_to_binary_file_mapped(const T &t,
+                                 const std::string &file_name,
+                                 const BinarySerializerOptions &options = {},
+                                 bool async_flush = false) {
+  MappedOutputFile file(file_name, serialized_size(t, options));
+  BinaryOutputSerializer writer;
+  writer.options = options;
+  writer.initialize(file.data(), file.size());
+  writer(t);
+  writer.finalize();
+  file.close(writer.head, async_flush);
+}
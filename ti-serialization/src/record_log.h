@@ -0,0 +1,450 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "serialization.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TI_SERIALIZATION_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//                   Append-only log of serialized records                    //
+////////////////////////////////////////////////////////////////////////////////
+
+// File layout, all integers are little-endian uint64:
+//
+//   header:  kMagic, index_interval
+//   frames:  size, <`size` bytes of a BinaryOutputSerializer buffer>
+//            ... every `index_interval` records, an index chunk:
+//            kChunkFlag | size, first_record, count, <count record offsets>
+//   footer:  <offset of each index chunk>, num_records, num_chunks, kMagic
+//
+// Record N is found in O(1) through the footer and the chunk N / interval, so
+// every chunk but the last holds exactly `index_interval` records. A log
+// without a valid footer (e.g. the writer crashed) is recovered by walking the
+// frames up to the last complete one.
+struct RecordLogFormat {
+  static constexpr uint64_t kMagic = 0x474f4c4345524954;  // "TIRECLOG"
+  static constexpr uint64_t kChunkFlag = uint64_t(1) << 63;
+  static constexpr std::size_t kHeaderSize = 2 * sizeof(uint64_t);
+  static constexpr std::size_t kFooterTailSize = 3 * sizeof(uint64_t);
+};
+
+class RecordLogWriter {
+ public:
+  enum class Mode {
+    kCreate,  // Replaces any existing file.
+    kAppend,  // Continues the log at `fn` if there is one.
+  };
+
+  // The reader has to use the same `options`. With `Mode::kAppend`, an
+  // existing log must have the same `index_interval`; its footer, if any, is
+  // rewritten by `close()`.
+  explicit RecordLogWriter(const std::string &fn,
+                           std::size_t index_interval = 1024,
+                           const BinarySerializerOptions &options = {},
+                           Mode mode = Mode::kCreate)
+      : index_interval_(index_interval) {
+    if (index_interval_ == 0) {
+      throw std::runtime_error("index interval must be positive");
+    }
+    std::error_code ec;
+    if (mode == Mode::kAppend && std::filesystem::file_size(fn, ec) != 0 &&
+        !ec) {
+      open_append(fn);
+    } else {
+      file_ = std::fopen(fn.c_str(), "wb");
+      if (file_ == nullptr) {
+        throw std::runtime_error("failed to open");
+      }
+      // Before anything else is done with the stream.
+      std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+      const uint64_t header[2] = {RecordLogFormat::kMagic, index_interval_};
+      try {
+        write_words(header, 2);
+      } catch (...) {
+        std::fclose(file_);
+        throw;
+      }
+    }
+    serializer_.options = options;
+  }
+
+  RecordLogWriter(const RecordLogWriter &) = delete;
+  RecordLogWriter &operator=(const RecordLogWriter &) = delete;
+
+  ~RecordLogWriter() {
+    if (file_ != nullptr) {
+      try {
+        close();
+      } catch (const std::exception &) {
+        // Without a footer the log is still readable through recovery.
+      }
+    }
+  }
+
+  // Serializes `t` as the next record and returns its index.
+  template <typename T>
+  std::size_t append(const T &t) {
+    // The serializer keeps its buffer, so steady-state appends don't allocate.
+    serializer_.initialize();
+    serializer_(t);
+    serializer_.finalize();
+    return append_raw(serializer_.data.data(), serializer_.head);
+  }
+
+  // Appends an already serialized buffer.
+  std::size_t append_raw(const uint8_t *data, std::size_t size) {
+    pending_offsets_.push_back(offset_);
+    const uint64_t frame = size;
+    write_words(&frame, 1);
+    write(data, size);
+    num_records_++;
+    if (pending_offsets_.size() == index_interval_) {
+      write_chunk();
+    }
+    return num_records_ - 1;
+  }
+
+  std::size_t size() const {
+    return num_records_;
+  }
+
+  // Writes the remaining index and the footer. Nothing can be appended after.
+  void close() {
+    if (!pending_offsets_.empty()) {
+      write_chunk();
+    }
+    write_words(chunk_offsets_.data(), chunk_offsets_.size());
+    const uint64_t tail[3] = {num_records_, chunk_offsets_.size(),
+                              RecordLogFormat::kMagic};
+    write_words(tail, 3);
+    const bool failed = std::fclose(file_) != 0;
+    file_ = nullptr;
+    if (failed) {
+      throw std::runtime_error("failed to write record log");
+    }
+  }
+
+ private:
+  // Defined after RecordLogReader, which it uses to find the records.
+  void open_append(const std::string &fn);
+
+  void write(const void *data, std::size_t size) {
+    if (std::fwrite(data, 1, size, file_) != size) {
+      throw std::runtime_error("failed to write record log");
+    }
+    offset_ += size;
+  }
+
+  void write_words(const uint64_t *words, std::size_t n) {
+    if (detail::kLittleEndianHost) {
+      write(words, sizeof(uint64_t) * n);
+      return;
+    }
+    for (std::size_t i = 0; i < n; i++) {
+      const uint64_t word = detail::to_le(words[i]);
+      write(&word, sizeof(word));
+    }
+  }
+
+  void write_chunk() {
+    chunk_offsets_.push_back(offset_);
+    const uint64_t size = 2 * sizeof(uint64_t) +
+                          sizeof(uint64_t) * pending_offsets_.size();
+    const uint64_t header[3] = {RecordLogFormat::kChunkFlag | size,
+                                num_records_ - pending_offsets_.size(),
+                                pending_offsets_.size()};
+    write_words(header, 3);
+    write_words(pending_offsets_.data(), pending_offsets_.size());
+    pending_offsets_.clear();
+  }
+
+  std::FILE *file_{nullptr};
+  BinaryOutputSerializer serializer_;
+  uint64_t index_interval_;
+  uint64_t offset_{0};
+  uint64_t num_records_{0};
+  std::vector<uint64_t> pending_offsets_;
+  std::vector<uint64_t> chunk_offsets_;
+};
+
+// Reads a log through a read-only mapping (or a plain read where mmap is not
+// available). All const member functions may be called concurrently, e.g.
+// one thread per `shard`. Offsets read from the file are checked, so a
+// corrupt log throws std::runtime_error instead of reading out of bounds.
+class RecordLogReader {
+ public:
+  explicit RecordLogReader(const std::string &fn,
+                           const BinarySerializerOptions &options = {})
+      : options_(options) {
+    map(fn);
+    try {
+      if (size_ < RecordLogFormat::kHeaderSize ||
+          load(0) != RecordLogFormat::kMagic) {
+        throw std::runtime_error("not a record log");
+      }
+      index_interval_ = load(sizeof(uint64_t));
+      if (index_interval_ == 0 || !open_footer()) {
+        recover();
+      }
+    } catch (...) {
+      unmap();
+      throw;
+    }
+  }
+
+  RecordLogReader(const RecordLogReader &) = delete;
+  RecordLogReader &operator=(const RecordLogReader &) = delete;
+
+  ~RecordLogReader() {
+    unmap();
+  }
+
+  std::size_t size() const {
+    return num_records_;
+  }
+
+  // The serialized bytes of record `n`.
+  std::pair<const uint8_t *, std::size_t> record(std::size_t n) const {
+    if (n >= num_records_) {
+      throw std::out_of_range("record index out of range");
+    }
+    const uint64_t offset = record_offset(n);
+    return {data_ + offset + sizeof(uint64_t), load(offset)};
+  }
+
+  template <typename T>
+  void read(std::size_t n, T &t) const {
+    const auto [ptr, size] = record(n);
+    BinaryInputSerializer reader;
+    reader.options = options_;
+    reader.initialize(const_cast<uint8_t *>(ptr));
+    reader(t);
+    reader.finalize();
+  }
+
+  // The records [begin, end) of shard `i` out of `num_shards` equal parts.
+  std::pair<std::size_t, std::size_t> shard(std::size_t i,
+                                            std::size_t num_shards) const {
+    return {num_records_ * i / num_shards,
+            num_records_ * (i + 1) / num_shards};
+  }
+
+  // Calls `f(index, record)` for each record in [begin, end), reusing one
+  // `T` for all of them.
+  template <typename T, typename F>
+  void for_each(std::size_t begin, std::size_t end, F &&f) const {
+    T t{};
+    for (std::size_t n = begin; n < end; n++) {
+      read(n, t);
+      f(n, t);
+    }
+  }
+
+ private:
+  friend class RecordLogWriter;
+
+  uint64_t load(std::size_t offset) const {
+    return detail::load_le<uint64_t>(data_ + offset);
+  }
+
+  // Offset of the frame of record `n` < `num_records_`.
+  uint64_t record_offset(std::size_t n) const {
+    if (!recovered_offsets_.empty()) {
+      return recovered_offsets_[n];
+    }
+    const uint64_t chunk = chunk_offset(n / index_interval_);
+    const uint64_t offset = load(chunk + 3 * sizeof(uint64_t) +
+                                 sizeof(uint64_t) * (n % index_interval_));
+    // The frame has to end before the footer, as a record and not a chunk.
+    if (offset < RecordLogFormat::kHeaderSize ||
+        offset > chunk_table_ - sizeof(uint64_t) ||
+        load(offset) > chunk_table_ - offset - sizeof(uint64_t)) {
+      throw std::runtime_error("corrupt record log");
+    }
+    return offset;
+  }
+
+  // Offset of index chunk `i`, which was checked by `open_footer` or found
+  // by `recover`.
+  uint64_t chunk_offset(std::size_t i) const {
+    if (chunk_table_ == 0) {
+      return recovered_chunks_[i];
+    }
+    return load(chunk_table_ + sizeof(uint64_t) * i);
+  }
+
+  // Where the next frame goes when appending: after the last record, or
+  // after the last chunk if that is full and comes later.
+  uint64_t frames_end() const {
+    uint64_t end = RecordLogFormat::kHeaderSize;
+    if (num_records_ != 0) {
+      const uint64_t offset = record_offset(num_records_ - 1);
+      end = offset + sizeof(uint64_t) + load(offset);
+    }
+    const std::size_t full_chunks = num_records_ / index_interval_;
+    if (full_chunks != 0) {
+      const uint64_t chunk = chunk_offset(full_chunks - 1);
+      end = std::max<uint64_t>(
+          end, chunk + sizeof(uint64_t) +
+                   (load(chunk) & ~RecordLogFormat::kChunkFlag));
+    }
+    return end;
+  }
+
+  void unmap() {
+#if defined(TI_SERIALIZATION_HAS_MMAP)
+    if (mapped_ != nullptr) {
+      munmap(mapped_, size_);
+      mapped_ = nullptr;
+    }
+#endif
+  }
+
+  void map(const std::string &fn) {
+#if defined(TI_SERIALIZATION_HAS_MMAP)
+    int fd = ::open(fn.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("failed to open");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("failed to stat");
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ != 0) {
+      mapped_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (mapped_ == MAP_FAILED) {
+      mapped_ = nullptr;
+      throw std::runtime_error("failed to mmap");
+    }
+    data_ = static_cast<const uint8_t *>(mapped_);
+#else
+    buffer_ = read_data_from_file(fn);
+    size_ = buffer_.size();
+    data_ = buffer_.data();
+#endif
+  }
+
+  bool open_footer() {
+    if (size_ < RecordLogFormat::kHeaderSize +
+                    RecordLogFormat::kFooterTailSize) {
+      return false;
+    }
+    const std::size_t tail = size_ - RecordLogFormat::kFooterTailSize;
+    if (load(tail + 2 * sizeof(uint64_t)) != RecordLogFormat::kMagic) {
+      return false;
+    }
+    const uint64_t num_records = load(tail);
+    const uint64_t num_chunks = load(tail + sizeof(uint64_t));
+    if (num_chunks > (tail - RecordLogFormat::kHeaderSize) / sizeof(uint64_t) ||
+        num_chunks != num_records / index_interval_ +
+                          (num_records % index_interval_ != 0)) {
+      return false;
+    }
+    const std::size_t chunk_table = tail - sizeof(uint64_t) * num_chunks;
+    // Each chunk has to lie between the header and the footer and index the
+    // records that the footer implies.
+    for (uint64_t i = 0; i < num_chunks; i++) {
+      const uint64_t chunk = load(chunk_table + sizeof(uint64_t) * i);
+      const uint64_t first = i * index_interval_;
+      const uint64_t count = std::min<uint64_t>(index_interval_,
+                                                num_records - first);
+      if (chunk < RecordLogFormat::kHeaderSize || chunk > chunk_table ||
+          (chunk_table - chunk) / sizeof(uint64_t) < 3 + count ||
+          load(chunk) != (RecordLogFormat::kChunkFlag |
+                          (2 + count) * sizeof(uint64_t)) ||
+          load(chunk + sizeof(uint64_t)) != first ||
+          load(chunk + 2 * sizeof(uint64_t)) != count) {
+        return false;
+      }
+    }
+    num_records_ = num_records;
+    chunk_table_ = chunk_table;
+    return true;
+  }
+
+  // Rebuilds the offsets by walking the frames; a truncated last frame is
+  // dropped.
+  void recover() {
+    std::size_t offset = RecordLogFormat::kHeaderSize;
+    while (offset + sizeof(uint64_t) <= size_) {
+      const uint64_t frame = load(offset);
+      const uint64_t size = frame & ~RecordLogFormat::kChunkFlag;
+      if (size > size_ - offset - sizeof(uint64_t)) {
+        break;
+      }
+      if ((frame & RecordLogFormat::kChunkFlag) == 0) {
+        recovered_offsets_.push_back(offset);
+      } else {
+        recovered_chunks_.push_back(offset);
+      }
+      offset += sizeof(uint64_t) + size;
+    }
+    num_records_ = recovered_offsets_.size();
+  }
+
+  BinarySerializerOptions options_;
+  const uint8_t *data_{nullptr};
+  std::size_t size_{0};
+#if defined(TI_SERIALIZATION_HAS_MMAP)
+  void *mapped_{nullptr};
+#else
+  std::vector<uint8_t> buffer_;
+#endif
+  uint64_t index_interval_{0};
+  std::size_t num_records_{0};
+  std::size_t chunk_table_{0};
+  std::vector<uint64_t> recovered_offsets_;
+  std::vector<uint64_t> recovered_chunks_;
+};
+
+inline void RecordLogWriter::open_append(const std::string &fn) {
+  uint64_t end;
+  {
+    RecordLogReader reader(fn);
+    if (reader.index_interval_ != index_interval_) {
+      throw std::runtime_error("record log has another index interval");
+    }
+    num_records_ = reader.num_records_;
+    // Full chunks are kept. The records after them, including those of a
+    // last partial chunk, are indexed again by the next chunk.
+    const std::size_t full_chunks = num_records_ / index_interval_;
+    for (std::size_t i = 0; i < full_chunks; i++) {
+      chunk_offsets_.push_back(reader.chunk_offset(i));
+    }
+    for (std::size_t n = full_chunks * index_interval_; n < num_records_;
+         n++) {
+      pending_offsets_.push_back(reader.record_offset(n));
+    }
+    end = reader.frames_end();
+  }
+  // Drops the footer, a partial chunk and any torn frame.
+  std::filesystem::resize_file(fn, end);
+  file_ = std::fopen(fn.c_str(), "ab");
+  if (file_ == nullptr) {
+    throw std::runtime_error("failed to open");
+  }
+  std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+  offset_ = end;
+}
@@ -0,0 +1,608 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "serialization.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//                  Decoding through the embedded schema                      //
+////////////////////////////////////////////////////////////////////////////////
+
+// Decodes buffers written with `BinarySerializerOptions::embed_schema` without
+// the C++ types, e.g. for inspection and conversion tools:
+//
+//   SchemaDecoder decoder(data.data(), data.size());
+//   std::cout << decoder.to_json() << std::endl;
+//   std::cout << decoder.to_json("particles.x") << std::endl;
+class SchemaDecoder {
+ public:
+  // A path into the first top-level value, resolved against the schema once.
+  struct Projection {
+    std::vector<uint32_t> fields;  // indices into `Schema::fields`
+    uint32_t type{0};
+  };
+
+  static bool has_schema(const uint8_t *data, std::size_t size) {
+    uint64_t magic = 0;
+    if (size < 3 * sizeof(uint64_t)) {
+      return false;
+    }
+    magic = detail::load_le<uint64_t>(data + size - sizeof(uint64_t));
+    return magic == Schema::kSchemaMagic;
+  }
+
+  SchemaDecoder(const uint8_t *data, std::size_t size) : data_(data) {
+    if (!has_schema(data, size)) {
+      throw std::runtime_error("buffer has no embedded schema");
+    }
+    const auto payload_size =
+        detail::load_le<uint64_t>(data + size - 2 * sizeof(uint64_t));
+    if (payload_size < sizeof(uint64_t) ||
+        payload_size > size - 2 * sizeof(uint64_t)) {
+      throw std::runtime_error("corrupted schema trailer");
+    }
+    payload_end_ = data + payload_size;
+
+    BinaryInputSerializer reader;
+    reader.initialize(const_cast<uint8_t *>(payload_end_));
+    reader(schema_);
+    reader.finalize();
+
+    field_index_.resize(schema_.types.size());
+    for (std::size_t t = 0; t < schema_.types.size(); t++) {
+      const SchemaType &type = schema_.types[t];
+      if (type.kind != SchemaKind::kStruct) {
+        continue;
+      }
+      for (uint32_t f = 0; f < type.num_fields; f++) {
+        const uint32_t index = type.first_field + f;
+        field_index_[t][schema_.field_name(schema_.fields[index])] = index;
+      }
+    }
+  }
+
+  // `field_index_` points into `schema_`.
+  SchemaDecoder(const SchemaDecoder &) = delete;
+  SchemaDecoder &operator=(const SchemaDecoder &) = delete;
+
+  const Schema &schema() const {
+    return schema_;
+  }
+
+  // All top-level values as JSON, wrapped in an array if there are several.
+  std::string to_json() const {
+    std::string out;
+    const uint8_t *p = data_ + sizeof(uint64_t);
+    rewind();
+    const bool multiple = schema_.roots.size() != 1;
+    if (multiple) {
+      out += "[";
+    }
+    for (std::size_t i = 0; i < schema_.roots.size(); i++) {
+      if (i != 0) {
+        out += ",";
+      }
+      p = emit(schema_.roots[i], p, out);
+    }
+    if (multiple) {
+      out += "]";
+    }
+    return out;
+  }
+
+  // The value at a dot-separated path of nested struct fields inside the
+  // first top-level value, as JSON.
+  std::string to_json(std::string_view path) const {
+    return to_json(compile(path));
+  }
+
+  std::string to_json(const Projection &projection) const {
+    if (schema_.roots.empty()) {
+      throw std::runtime_error("buffer has no top-level values");
+    }
+    const uint8_t *p = data_ + sizeof(uint64_t);
+    rewind();
+    uint32_t type = schema_.roots[0];
+    for (uint32_t target : projection.fields) {
+      const SchemaType &st = schema_.types[type];
+      for (uint32_t f = st.first_field; f < target; f++) {
+        p = skip(schema_.fields[f].type, p);
+      }
+      type = schema_.fields[target].type;
+    }
+    std::string out;
+    emit(type, p, out);
+    return out;
+  }
+
+  Projection compile(std::string_view path) const {
+    if (schema_.roots.empty()) {
+      throw std::runtime_error("buffer has no top-level values");
+    }
+    Projection projection;
+    projection.type = schema_.roots[0];
+    while (!path.empty()) {
+      const std::size_t dot = path.find('.');
+      const std::string_view name = path.substr(0, dot);
+      path = (dot == std::string_view::npos) ? std::string_view()
+                                             : path.substr(dot + 1);
+      const auto &index = field_index_[projection.type];
+      auto it = index.find(name);
+      if (it == index.end()) {
+        throw std::runtime_error("no field named " + std::string(name));
+      }
+      projection.fields.push_back(it->second);
+      projection.type = schema_.fields[it->second].type;
+    }
+    return projection;
+  }
+
+ private:
+  const uint8_t *check(const uint8_t *p, std::size_t size) const {
+    if (size > std::size_t(payload_end_ - p)) {
+      throw std::runtime_error("truncated payload");
+    }
+    return p + size;
+  }
+
+  template <typename T>
+  T load(const uint8_t *&p) const {
+    T val;
+    const uint8_t *next = check(p, sizeof(T));
+    std::memcpy(&val, p, sizeof(T));
+    p = next;
+    return detail::to_le(val);
+  }
+
+  // Resets the state carried along a decoding pass.
+  void rewind() const {
+    flag_bits_used_ = 8;
+    blobs_.clear();
+  }
+
+  // Whether `n` values of `packed_size` bytes are a deduplicated blob, see
+  // `BinarySerializer::process_blob`.
+  bool is_blob(uint32_t packed_size, std::size_t n) const {
+    return schema_.dedup_min_bytes != 0 && packed_size != 0 &&
+           n * packed_size >= schema_.dedup_min_bytes;
+  }
+
+  // The same for a `std::vector` of `n` values of type `element`.
+  // `std::vector<bool>` has its own format.
+  bool is_blob_vector(uint32_t element, std::size_t n) const {
+    const SchemaType &type = schema_.types[element];
+    return type.kind != SchemaKind::kBool && is_blob(type.packed_size, n);
+  }
+
+  // Reads a blob reference or inline blob of `size` bytes. Returns its
+  // contents, which are somewhere in the payload.
+  const uint8_t *load_blob(const uint8_t *&p, std::size_t size) const {
+    const auto tag = static_cast<detail::BlobTag>(load<uint8_t>(p));
+    BlobId id;
+    id.lo = load<uint64_t>(p);
+    id.hi = load<uint64_t>(p);
+    if (tag == detail::BlobTag::kInline) {
+      const uint8_t *contents = p;
+      p = check(p, size);
+      blobs_.emplace(id, contents);
+      return contents;
+    }
+    if (tag == detail::BlobTag::kReference) {
+      auto it = blobs_.find(id);
+      if (it == blobs_.end()) {
+        throw std::runtime_error("unresolved blob reference");
+      }
+      return it->second;
+    }
+    if (tag == detail::BlobTag::kStored) {
+      throw std::runtime_error("blob is in an external BlobStore");
+    }
+    throw std::runtime_error("unknown blob tag");
+  }
+
+  // The next packed flag, mirroring `BinarySerializer::process(const bool &)`.
+  bool load_flag(const uint8_t *&p) const {
+    if (flag_bits_used_ == 8) {
+      flag_byte_ = load<uint8_t>(p);
+      flag_bits_used_ = 0;
+    }
+    return (flag_byte_ >> flag_bits_used_++) & 1;
+  }
+
+  // Bytes used by a tagged float array of `n` values after its tag.
+  static std::size_t float_array_bytes(FloatArrayEncoding encoding,
+                                       std::size_t n) {
+    switch (encoding) {
+      case FloatArrayEncoding::kRaw:
+        return sizeof(float) * n;
+      case FloatArrayEncoding::kFp16:
+      case FloatArrayEncoding::kBf16:
+        return 2 * n;
+      case FloatArrayEncoding::kQuant8:
+        return 2 * sizeof(float) + n;
+      case FloatArrayEncoding::kQuant16:
+        return 2 * sizeof(float) + 2 * n;
+    }
+    throw std::runtime_error("unknown float array encoding");
+  }
+
+  std::size_t int_array_bytes(IntArrayEncoding encoding,
+                              const uint8_t *p,
+                              std::size_t n) const {
+    if (encoding == IntArrayEncoding::kRaw) {
+      return sizeof(uint32_t) * n;
+    }
+    if (encoding != IntArrayEncoding::kDeltaBitPacked) {
+      throw std::runtime_error("unknown int array encoding");
+    }
+    const uint8_t *begin = p;
+    for (std::size_t i = 0; i < n; i += detail::BitPackedBlock::kSize) {
+      check(p, detail::BitPackedBlock::kHeaderBytes);
+      const uint32_t bits = p[sizeof(int32_t)];
+      p = check(p, detail::BitPackedBlock::packed_bytes(bits));
+    }
+    return p - begin;
+  }
+
+  const uint8_t *skip(uint32_t type_id, const uint8_t *p) const {
+    const SchemaType &type = schema_.types[type_id];
+    if (type.packed_size != 0) {
+      return check(p, type.packed_size);
+    }
+    switch (type.kind) {
+      case SchemaKind::kString: {
+        const auto n = load<uint64_t>(p);
+        if (is_blob(1, n)) {
+          load_blob(p, n);
+          return p;
+        }
+        return check(p, n);
+      }
+      case SchemaKind::kVector:
+      case SchemaKind::kSet: {
+        const auto n = load<uint64_t>(p);
+        const uint32_t elem_size = schema_.types[type.element].packed_size;
+        if (type.kind == SchemaKind::kVector &&
+            is_blob_vector(type.element, n)) {
+          load_blob(p, n * elem_size);
+          return p;
+        }
+        if (elem_size != 0) {
+          if (n > std::size_t(payload_end_ - p) / elem_size) {
+            throw std::runtime_error("truncated payload");
+          }
+          return p + n * elem_size;
+        }
+        for (std::size_t i = 0; i < n; i++) {
+          p = skip(type.element, p);
+        }
+        return p;
+      }
+      case SchemaKind::kArray:
+        for (uint32_t i = 0; i < type.size; i++) {
+          p = skip(type.element, p);
+        }
+        return p;
+      case SchemaKind::kOptional:
+        return load<bool>(p) ? skip(type.element, p) : p;
+      case SchemaKind::kPackedBool:
+        load_flag(p);
+        return p;
+      case SchemaKind::kPackedOptional:
+        return load_flag(p) ? skip(type.element, p) : p;
+      case SchemaKind::kBitVector: {
+        const auto n = load<uint64_t>(p);
+        return check(p, (n + 7) / 8);
+      }
+      case SchemaKind::kPair:
+        return skip(type.element, skip(type.key, p));
+      case SchemaKind::kMap: {
+        const auto n = load<uint64_t>(p);
+        for (std::size_t i = 0; i < n; i++) {
+          p = skip(type.element, skip(type.key, p));
+        }
+        return p;
+      }
+      case SchemaKind::kStruct:
+        for (uint32_t f = 0; f < type.num_fields; f++) {
+          p = skip(schema_.fields[type.first_field + f].type, p);
+        }
+        return p;
+      case SchemaKind::kUniquePtr:
+        return load<uint64_t>(p) ? skip(type.element, p) : p;
+      case SchemaKind::kTaggedFloatArray: {
+        const auto n = load<uint64_t>(p);
+        const auto encoding = static_cast<FloatArrayEncoding>(load<uint8_t>(p));
+        return check(p, float_array_bytes(encoding, n));
+      }
+      case SchemaKind::kTaggedIntArray: {
+        const auto n = load<uint64_t>(p);
+        const auto encoding = static_cast<IntArrayEncoding>(load<uint8_t>(p));
+        return check(p, int_array_bytes(encoding, p, n));
+      }
+      default:
+        throw std::runtime_error("cannot skip undescribed type");
+    }
+  }
+
+  static void emit_number(double val, const char *format, std::string &out) {
+    if (!std::isfinite(val)) {
+      out += "null";
+      return;
+    }
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), format, val);
+    out += buf;
+  }
+
+  static void emit_string(std::string_view str, std::string &out) {
+    detail::append_json_string(out, str);
+  }
+
+  const uint8_t *emit_scalar(const SchemaType &type,
+                             const uint8_t *p,
+                             std::string &out) const {
+    const bool is_signed = type.kind == SchemaKind::kInt;
+    switch (type.size) {
+      case 1:
+        out += is_signed ? std::to_string(load<int8_t>(p))
+                         : std::to_string(load<uint8_t>(p));
+        return p;
+      case 2:
+        out += is_signed ? std::to_string(load<int16_t>(p))
+                         : std::to_string(load<uint16_t>(p));
+        return p;
+      case 4:
+        out += is_signed ? std::to_string(load<int32_t>(p))
+                         : std::to_string(load<uint32_t>(p));
+        return p;
+      case 8:
+        out += is_signed ? std::to_string(load<int64_t>(p))
+                         : std::to_string(load<uint64_t>(p));
+        return p;
+    }
+    throw std::runtime_error("unsupported integer size");
+  }
+
+  void emit_float_array(const uint8_t *p,
+                        std::size_t n,
+                        FloatArrayEncoding encoding,
+                        std::string &out) const {
+    std::vector<float> values(n);
+    switch (encoding) {
+      case FloatArrayEncoding::kRaw:
+        detail::copy_le<float>(values.data(), p, n);
+        break;
+      case FloatArrayEncoding::kFp16:
+        detail::half_to_float(p, values.data(), n);
+        break;
+      case FloatArrayEncoding::kBf16:
+        detail::bf16_to_float(p, values.data(), n);
+        break;
+      case FloatArrayEncoding::kQuant8:
+      case FloatArrayEncoding::kQuant16: {
+        float lo, hi;
+        lo = detail::load_le<float>(p);
+        hi = detail::load_le<float>(p + sizeof(float));
+        p += 2 * sizeof(float);
+        if (encoding == FloatArrayEncoding::kQuant8) {
+          detail::quantized_to_float<uint8_t>(p, values.data(), n, lo, hi);
+        } else {
+          detail::quantized_to_float<uint16_t>(p, values.data(), n, lo, hi);
+        }
+        break;
+      }
+    }
+    out += "[";
+    for (std::size_t i = 0; i < n; i++) {
+      if (i != 0) {
+        out += ",";
+      }
+      emit_number(values[i], "%.9g", out);
+    }
+    out += "]";
+  }
+
+  const uint8_t *emit(uint32_t type_id,
+                      const uint8_t *p,
+                      std::string &out) const {
+    const SchemaType &type = schema_.types[type_id];
+    switch (type.kind) {
+      case SchemaKind::kBool:
+        out += load<bool>(p) ? "true" : "false";
+        return p;
+      case SchemaKind::kPackedBool:
+        out += load_flag(p) ? "true" : "false";
+        return p;
+      case SchemaKind::kInt:
+      case SchemaKind::kUInt:
+        return emit_scalar(type, p, out);
+      case SchemaKind::kFloat:
+        if (type.size == sizeof(float)) {
+          emit_number(load<float>(p), "%.9g", out);
+        } else {
+          emit_number(load<double>(p), "%.17g", out);
+        }
+        return p;
+      case SchemaKind::kPointer:
+        out += std::to_string(load<uint64_t>(p));
+        return p;
+      case SchemaKind::kString: {
+        const auto n = load<uint64_t>(p);
+        if (is_blob(1, n)) {
+          const uint8_t *contents = load_blob(p, n);
+          emit_string({reinterpret_cast<const char *>(contents), n}, out);
+          return p;
+        }
+        const uint8_t *next = check(p, n);
+        emit_string({reinterpret_cast<const char *>(p), n}, out);
+        return next;
+      }
+      case SchemaKind::kVector:
+      case SchemaKind::kSet:
+      case SchemaKind::kArray: {
+        const std::size_t n = (type.kind == SchemaKind::kArray)
+                                  ? std::size_t(type.size)
+                                  : load<uint64_t>(p);
+        const uint8_t *next = nullptr;
+        if (type.kind == SchemaKind::kVector &&
+            is_blob_vector(type.element, n)) {
+          // The elements are read from the first occurrence.
+          const uint8_t *contents = load_blob(
+              p, n * schema_.types[type.element].packed_size);
+          next = p;
+          p = contents;
+        }
+        out += "[";
+        for (std::size_t i = 0; i < n; i++) {
+          if (i != 0) {
+            out += ",";
+          }
+          p = emit(type.element, p, out);
+        }
+        out += "]";
+        return next != nullptr ? next : p;
+      }
+      case SchemaKind::kOptional:
+      case SchemaKind::kPackedOptional: {
+        const bool has_value = (type.kind == SchemaKind::kOptional)
+                                   ? load<bool>(p)
+                                   : load_flag(p);
+        if (!has_value) {
+          out += "null";
+          return p;
+        }
+        return emit(type.element, p, out);
+      }
+      case SchemaKind::kBitVector: {
+        const auto n = load<uint64_t>(p);
+        const uint8_t *next = check(p, (n + 7) / 8);
+        out += "[";
+        for (std::size_t i = 0; i < n; i++) {
+          if (i != 0) {
+            out += ",";
+          }
+          out += ((p[i / 8] >> (i % 8)) & 1) ? "true" : "false";
+        }
+        out += "]";
+        return next;
+      }
+      case SchemaKind::kUniquePtr:
+        if (load<uint64_t>(p) == 0) {
+          out += "null";
+          return p;
+        }
+        return emit(type.element, p, out);
+      case SchemaKind::kPair:
+        out += "[";
+        p = emit(type.key, p, out);
+        out += ",";
+        p = emit(type.element, p, out);
+        out += "]";
+        return p;
+      case SchemaKind::kMap: {
+        const auto n = load<uint64_t>(p);
+        const bool string_keys =
+            schema_.types[type.key].kind == SchemaKind::kString;
+        out += "{";
+        for (std::size_t i = 0; i < n; i++) {
+          if (i != 0) {
+            out += ",";
+          }
+          if (string_keys) {
+            p = emit(type.key, p, out);
+          } else {
+            // Other keys are written as JSON text inside a string.
+            std::string key;
+            p = emit(type.key, p, key);
+            emit_string(key, out);
+          }
+          out += ":";
+          p = emit(type.element, p, out);
+        }
+        out += "}";
+        return p;
+      }
+      case SchemaKind::kStruct:
+        out += "{";
+        for (uint32_t f = 0; f < type.num_fields; f++) {
+          const SchemaField &field = schema_.fields[type.first_field + f];
+          if (f != 0) {
+            out += ",";
+          }
+          emit_string(schema_.field_name(field), out);
+          out += ":";
+          p = emit(field.type, p, out);
+        }
+        out += "}";
+        return p;
+      case SchemaKind::kTaggedFloatArray: {
+        const auto n = load<uint64_t>(p);
+        const auto encoding = static_cast<FloatArrayEncoding>(load<uint8_t>(p));
+        const uint8_t *next = check(p, float_array_bytes(encoding, n));
+        emit_float_array(p, n, encoding, out);
+        return next;
+      }
+      case SchemaKind::kTaggedIntArray: {
+        const auto n = load<uint64_t>(p);
+        const auto encoding = static_cast<IntArrayEncoding>(load<uint8_t>(p));
+        const uint8_t *next = check(p, int_array_bytes(encoding, p, n));
+        std::vector<uint32_t> values(n);
+        if (encoding == IntArrayEncoding::kRaw) {
+          detail::copy_le<uint32_t>(values.data(), p, n);
+        } else {
+          detail::delta_bitunpack(p, n, values.data());
+        }
+        const bool is_signed =
+            schema_.types[type.element].kind == SchemaKind::kInt;
+        out += "[";
+        for (std::size_t i = 0; i < n; i++) {
+          if (i != 0) {
+            out += ",";
+          }
+          out += is_signed ? std::to_string(int32_t(values[i]))
+                           : std::to_string(values[i]);
+        }
+        out += "]";
+        return next;
+      }
+      case SchemaKind::kOpaque: {
+        if (type.size == 0) {
+          throw std::runtime_error("cannot decode undescribed type");
+        }
+        const uint8_t *next = check(p, type.size);
+        static const char kHex[] = "0123456789abcdef";
+        out += '"';
+        for (; p != next; p++) {
+          out += kHex[*p >> 4];
+          out += kHex[*p & 15];
+        }
+        out += '"';
+        return next;
+      }
+    }
+    throw std::runtime_error("unknown schema kind");
+  }
+
+  const uint8_t *data_;
+  const uint8_t *payload_end_;
+  // State of the current decoding pass. Decoding is sequential, so one
+  // decoder must not be used from several threads at once.
+  mutable uint8_t flag_byte_{0};
+  mutable unsigned flag_bits_used_{8};
+  // Contents of the inline blobs seen so far, for later references.
+  mutable std::unordered_map<BlobId, const uint8_t *, BlobIdHash> blobs_;
+  Schema schema_;
+  // Per struct type, field name -> index into `schema_.fields`.
+  std::vector<std::unordered_map<std::string_view, uint32_t>> field_index_;
+};
@@ -7,18 +7,35 @@
 
 #include <array>
 #include <cassert>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <memory>
 #include <optional>
+#include <set>
 #include <sstream>
 #include <string_view>
+#include <tuple>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "blob_store.h"
+#include "byte_order.h"
+#include "flat_map.h"
+#include "float_codec.h"
+#include "int_codec.h"
+#include "json_escape.h"
+#include "serialization_profiler.h"
+
 template <typename T>
 std::unique_ptr<T> create_instance_unique(const std::string &alias);
 
@@ -38,10 +55,47 @@ using remove_cvref_t = typename remove_cvref<T>::type;
 
 }  // namespace type
 
-class TextSerializer;
+template <typename ProfilingPolicy = NoProfiling>
+class BasicTextSerializer;
+
+using TextSerializer = BasicTextSerializer<>;
 
 namespace detail {
 
+template <typename T>
+struct is_text_serializer : std::false_type {};
+
+template <typename ProfilingPolicy>
+struct is_text_serializer<BasicTextSerializer<ProfilingPolicy>>
+    : std::true_type {};
+
+// Containers report their size to the profiling policy, anything else 1.
+template <typename T, typename = void>
+struct element_count {
+  static std::size_t get(const T &) {
+    return 1;
+  }
+};
+
+template <typename T>
+struct element_count<T, std::void_t<decltype(std::declval<const T &>().size())>> {
+  static std::size_t get(const T &val) {
+    return val.size();
+  }
+};
+
+// Hash containers, which are given their final size before loading.
+template <typename T, typename = void>
+struct has_reserve : std::false_type {};
+
+template <typename T>
+struct has_reserve<
+    T,
+    std::void_t<decltype(std::declval<T &>().reserve(std::size_t()))>>
+    : std::true_type {};
+
+struct Empty {};
+
 template <size_t N>
 constexpr size_t count_delim(const char (&str)[N], char delim) {
   size_t count = 1;
@@ -90,7 +144,7 @@ void serialize_kv_impl(SER &ser,
 }
 
 template <typename SER, size_t N, typename T, typename... Args>
-typename std::enable_if<!std::is_same<SER, TextSerializer>::value, void>::type
+typename std::enable_if<!is_text_serializer<SER>::value, void>::type
 serialize_kv_impl(SER &ser,
                   const std::array<std::string_view, N> &keys,
                   T &&head,
@@ -104,7 +158,7 @@ serialize_kv_impl(SER &ser,
 // Specialize for TextSerializer since we need to append comma in the end for
 // non-last object.
 template <typename SER, size_t N, typename T, typename... Args>
-typename std::enable_if<std::is_same<SER, TextSerializer>::value, void>::type
+typename std::enable_if<is_text_serializer<SER>::value, void>::type
 serialize_kv_impl(SER &ser,
                   const std::array<std::string_view, N> &keys,
                   T &&head,
@@ -121,10 +175,16 @@ serialize_kv_impl(SER &ser,
   template <typename S> \
   void io(S &serializer) const
 
-#define TI_IO_DEF(...)           \
-  template <typename S>          \
-  void io(S &serializer) const { \
-    TI_IO(__VA_ARGS__);          \
+// Besides `io()`, this also defines `ti_io_fields()`, which only exists so
+// that the field types can be inspected at compile time (see
+// detail::fixed_packed_size).
+#define TI_IO_DEF(...)             \
+  auto ti_io_fields() const {      \
+    return std::tie(__VA_ARGS__);  \
+  }                                \
+  template <typename S>            \
+  void io(S &serializer) const {   \
+    TI_IO(__VA_ARGS__);            \
   }
 
 // This macro serializes each field with its name by doing the following:
@@ -144,11 +204,6 @@ serialize_kv_impl(SER &ser,
   (std::is_same<typename std::remove_reference<decltype(serializer)>::type, \
                 T>())
 
-#if !defined(TI_ARCH_x86)
-static_assert(
-    sizeof(std::size_t) == sizeof(uint64_t),
-    "sizeof(std::size_t) should be 8. Try compiling with 64bit mode.");
-#endif
 template <typename T, typename S>
 struct IO {
   using implemented = std::false_type;
@@ -200,6 +255,282 @@ class Serializer {
   };
 };
 
+namespace detail {
+
+template <typename T, typename = void>
+struct io_field_types {
+  using type = void;
+};
+
+template <typename T>
+struct io_field_types<
+    T,
+    std::void_t<decltype(std::declval<const T &>().ti_io_fields())>> {
+  using type = decltype(std::declval<const T &>().ti_io_fields());
+};
+
+template <typename T>
+inline constexpr bool has_io_field_types_v =
+    !std::is_void_v<typename io_field_types<T>::type>;
+
+template <typename T>
+constexpr std::size_t fixed_packed_size();
+
+// C arrays and non-empty std::arrays of PODs, whose elements are stored one
+// after another and byte-swapped individually on big-endian hosts.
+template <typename T>
+struct fixed_array_traits {
+  static constexpr bool value = std::is_array_v<T>;
+  using element = std::remove_extent_t<T>;
+  static constexpr std::size_t extent = std::extent_v<T>;
+};
+
+template <typename T, std::size_t N>
+struct fixed_array_traits<std::array<T, N>> {
+  static constexpr bool value = N != 0 && std::is_pod_v<T>;
+  using element = T;
+  static constexpr std::size_t extent = N;
+};
+
+template <typename Fields>
+struct fields_packed_size;
+
+template <typename... Fields>
+struct fields_packed_size<std::tuple<Fields...>> {
+  static constexpr bool all_fixed =
+      ((fixed_packed_size<type::remove_cvref_t<Fields>>() != 0) && ...);
+  static constexpr std::size_t value =
+      all_fixed
+          ? (fixed_packed_size<type::remove_cvref_t<Fields>>() + ... + 0)
+          : 0;
+};
+
+// The number of bytes `BinarySerializer` always uses for a `T`, or 0 if that
+// depends on the value. Fixed are elementary types, enums, C-arrays of fixed
+// types and TI_IO_DEF structs whose fields are all fixed. Those are copied in
+// one go instead of field by field, see `store_fixed` and `load_fixed`.
+template <typename T>
+constexpr std::size_t fixed_packed_size() {
+  if constexpr (fixed_array_traits<T>::value) {
+    return fixed_array_traits<T>::extent *
+           fixed_packed_size<typename fixed_array_traits<T>::element>();
+  } else if constexpr (std::is_enum_v<T>) {
+    return sizeof(T);
+  } else if constexpr (has_io_field_types_v<T>) {
+    return fields_packed_size<typename io_field_types<T>::type>::value;
+  } else if constexpr (Serializer::has_io<T>::value ||
+                       std::is_pointer_v<T> || !std::is_pod_v<T>) {
+    return 0;
+  } else {
+    return sizeof(T);
+  }
+}
+
+template <typename T>
+constexpr bool fixed_layout_has_bool();
+
+template <typename Fields>
+struct fields_have_bool;
+
+template <typename... Fields>
+struct fields_have_bool<std::tuple<Fields...>> {
+  static constexpr bool value =
+      (fixed_layout_has_bool<type::remove_cvref_t<Fields>>() || ...);
+};
+
+// Whether a fixed-layout `T` contains a `bool`. Those are not copied in one
+// go when `BinarySerializerOptions::pack_bools` is on, since each bool then
+// takes a single bit.
+template <typename T>
+constexpr bool fixed_layout_has_bool() {
+  if constexpr (std::is_array_v<T>) {
+    return fixed_layout_has_bool<std::remove_extent_t<T>>();
+  } else if constexpr (std::is_enum_v<T>) {
+    return std::is_same_v<std::underlying_type_t<T>, bool>;
+  } else if constexpr (has_io_field_types_v<T>) {
+    return fields_have_bool<typename io_field_types<T>::type>::value;
+  } else {
+    return std::is_same_v<T, bool>;
+  }
+}
+
+// Whether the packed form of `val` is a verbatim copy of its memory, i.e.
+// there is no padding and the fields are listed in declaration order. The
+// field addresses are known at compile time, so this usually folds away.
+template <typename T>
+bool is_packed_in_memory(const T &val) {
+  if constexpr (sizeof(T) != fixed_packed_size<T>()) {
+    return false;
+  } else if constexpr (fixed_array_traits<T>::value) {
+    return is_packed_in_memory(val[0]);
+  } else if constexpr (has_io_field_types_v<T>) {
+    if constexpr (!std::is_trivially_copyable_v<T>) {
+      return false;
+    } else {
+      return std::apply(
+          [&val](const auto &...fields) {
+            const auto *base = reinterpret_cast<const uint8_t *>(&val);
+            std::size_t offset = 0;
+            bool packed = true;
+            ((packed = packed &&
+                       reinterpret_cast<const uint8_t *>(&fields) ==
+                           base + offset &&
+                       is_packed_in_memory(fields),
+              offset += sizeof(fields)),
+             ...);
+            return packed;
+          },
+          val.ti_io_fields());
+    }
+  } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+    // Stored little-endian.
+    return kLittleEndianHost || sizeof(T) == 1;
+  } else {
+    // Opaque, see `store_fixed`.
+    return true;
+  }
+}
+
+template <typename T>
+void store_fixed(uint8_t *dst, const T &val) {
+  constexpr std::size_t kSize = fixed_packed_size<T>();
+  static_assert(kSize != 0, "");
+  if constexpr (fixed_array_traits<T>::value) {
+    constexpr std::size_t kElemSize =
+        fixed_packed_size<typename fixed_array_traits<T>::element>();
+    for (std::size_t i = 0; i < fixed_array_traits<T>::extent; i++) {
+      store_fixed(dst + i * kElemSize, val[i]);
+    }
+  } else if constexpr (has_io_field_types_v<T>) {
+    if (is_packed_in_memory(val)) {
+      std::memcpy(dst, &val, kSize);
+      return;
+    }
+    std::apply(
+        [dst](const auto &...fields) {
+          std::size_t offset = 0;
+          ((store_fixed(dst + offset, fields),
+            offset += fixed_packed_size<
+                type::remove_cvref_t<decltype(fields)>>()),
+           ...);
+        },
+        val.ti_io_fields());
+  } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+    store_le(dst, val);
+  } else {
+    // A POD without TI_IO_DEF is copied as is, so its multi-byte members
+    // would come out in host order.
+    static_assert(kLittleEndianHost || alignof(T) == 1,
+                  "POD types need TI_IO_DEF on big-endian hosts");
+    std::memcpy(dst, &val, kSize);
+  }
+}
+
+template <typename T>
+void load_fixed(const uint8_t *src, const T &val) {
+  constexpr std::size_t kSize = fixed_packed_size<T>();
+  static_assert(kSize != 0, "");
+  if constexpr (fixed_array_traits<T>::value) {
+    constexpr std::size_t kElemSize =
+        fixed_packed_size<typename fixed_array_traits<T>::element>();
+    for (std::size_t i = 0; i < fixed_array_traits<T>::extent; i++) {
+      load_fixed(src + i * kElemSize, val[i]);
+    }
+  } else if constexpr (has_io_field_types_v<T>) {
+    if (is_packed_in_memory(val)) {
+      // Trivially copyable, as checked by `is_packed_in_memory`.
+      std::memcpy(static_cast<void *>(&Serializer::get_writable(val)), src,
+                  kSize);
+      return;
+    }
+    std::apply(
+        [src](const auto &...fields) {
+          std::size_t offset = 0;
+          ((load_fixed(src + offset, fields),
+            offset += fixed_packed_size<
+                type::remove_cvref_t<decltype(fields)>>()),
+           ...);
+        },
+        val.ti_io_fields());
+  } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+    Serializer::get_writable(val) = load_le<T>(src);
+  } else {
+    static_assert(kLittleEndianHost || alignof(T) == 1,
+                  "POD types need TI_IO_DEF on big-endian hosts");
+    std::memcpy(&Serializer::get_writable(val), src, kSize);
+  }
+}
+
+// `store_fixed` for `n` consecutive values, with a single copy where possible.
+template <typename T>
+void store_fixed_array(uint8_t *dst, const T *val, std::size_t n) {
+  constexpr std::size_t kSize = fixed_packed_size<T>();
+  // Also instantiated, but never called, for types without a fixed layout.
+  if constexpr (kSize != 0) {
+    if (n == 0) {
+      return;
+    }
+    if (is_packed_in_memory(val[0])) {
+      std::memcpy(dst, val, kSize * n);
+    } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+      copy_le<T>(dst, val, n);
+    } else {
+      for (std::size_t i = 0; i < n; i++) {
+        store_fixed(dst + kSize * i, val[i]);
+      }
+    }
+  }
+}
+
+template <typename T>
+void load_fixed_array(const uint8_t *src, const T *val, std::size_t n) {
+  constexpr std::size_t kSize = fixed_packed_size<T>();
+  if constexpr (kSize != 0) {
+    if (n == 0) {
+      return;
+    }
+    if (is_packed_in_memory(val[0])) {
+      std::memcpy(static_cast<void *>(const_cast<T *>(val)), src, kSize * n);
+    } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+      copy_le<T>(const_cast<T *>(val), src, n);
+    } else {
+      for (std::size_t i = 0; i < n; i++) {
+        load_fixed(src + kSize * i, val[i]);
+      }
+    }
+  }
+}
+
+// Stores `bits` LSB first in `(bits.size() + 7) / 8` bytes.
+inline void pack_bits(const std::vector<bool> &bits, uint8_t *out) {
+  const std::size_t n = bits.size();
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint8_t byte = 0;
+    for (std::size_t j = 0; j < 8; j++) {
+      byte |= uint8_t(bits[i + j]) << j;
+    }
+    out[i / 8] = byte;
+  }
+  if (i != n) {
+    uint8_t byte = 0;
+    for (std::size_t j = 0; i + j < n; j++) {
+      byte |= uint8_t(bits[i + j]) << j;
+    }
+    out[i / 8] = byte;
+  }
+}
+
+// The inverse of `pack_bits`; `bits` must already have the right size.
+inline void unpack_bits(const uint8_t *in, std::vector<bool> &bits) {
+  const std::size_t n = bits.size();
+  for (std::size_t i = 0; i < n; i++) {
+    bits[i] = (in[i / 8] >> (i % 8)) & 1;
+  }
+}
+
+}  // namespace detail
+
 inline std::vector<uint8_t> read_data_from_file(const std::string &fn) {
   std::vector<uint8_t> data;
   std::FILE *f = fopen(fn.c_str(), "rb");
@@ -238,7 +569,301 @@ inline void write_data_to_file(const std::string &fn,
   std::fclose(f);
 }
 
-template <bool writing>
+// Opt-in encodings of `BinarySerializer`. They change the binary format, so
+// the reader must be configured with the same options as the writer.
+struct BinarySerializerOptions {
+  // Applies to every `std::vector<float>`. When not `kRaw`, each array records
+  // its encoding, so readers only need to know that the option is on.
+  FloatArrayEncoding float_array_encoding{FloatArrayEncoding::kRaw};
+  // Applies to every `std::vector<int32_t>` and `std::vector<uint32_t>`, with
+  // the same tagging as above.
+  IntArrayEncoding int_array_encoding{IntArrayEncoding::kRaw};
+  // Appends a description of the written types to the buffer, so that tools
+  // can decode it without the C++ definitions (see schema_decoder.h). Typed
+  // readers ignore it and need no configuration.
+  bool embed_schema{false};
+  // Stores each `bool`, including the presence flag of `std::optional`, as a
+  // single bit. Consecutive flags share a byte that is reserved where the
+  // first of them is written, so a record with dozens of flags takes a few
+  // bytes for them. `std::vector<bool>` is stored as a bit array.
+  bool pack_bools{false};
+  // When not 0, `std::string`s and vectors of fixed-layout types of at least
+  // this many bytes are stored once per distinct content: later occurrences
+  // in the same buffer only refer to the first by its hash. Arrays with a
+  // float or int encoding other than `kRaw` are not deduplicated.
+  std::size_t dedup_min_bytes{0};
+  // With `dedup_min_bytes`, puts such blobs into this store instead of the
+  // buffer, so that they are also shared across buffers (e.g. consecutive
+  // checkpoints). The reader needs the same store.
+  BlobStore *blob_store{nullptr};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//                              Embedded schema                               //
+////////////////////////////////////////////////////////////////////////////////
+
+// A schema is a flat table of types that reference each other by index.
+// With `embed_schema`, the writer appends it after the payload as
+//   schema (itself in binary format), uint64 payload size, kSchemaMagic
+// so its presence can be detected from the end of the buffer.
+enum class SchemaKind : uint8_t {
+  kBool,
+  kInt,       // `size` bytes, signed
+  kUInt,      // `size` bytes, unsigned
+  kFloat,     // `size` bytes
+  kString,
+  kVector,    // of `element`
+  kArray,     // `size` x `element`, no length prefix
+  kOptional,  // of `element`
+  kPair,      // `key`, `element`
+  kMap,       // `key` -> `element`
+  kStruct,    // `num_fields` fields starting at `first_field`
+  kUniquePtr,
+  kPointer,
+  kOpaque,           // `size` bytes of some POD type, or undescribable if 0
+  kTaggedFloatArray,  // std::vector<float> with FloatArrayEncoding
+  kTaggedIntArray,    // std::vector<`element`> with IntArrayEncoding
+  kPackedBool,        // a bit of the current flag byte, see `pack_bools`
+  kPackedOptional,    // of `element`, with a packed presence flag
+  kBitVector,         // std::vector<bool> with `pack_bools`
+  kSet,               // of `element`, like kVector but never deduplicated
+};
+
+struct SchemaType {
+  SchemaKind kind{SchemaKind::kOpaque};
+  uint32_t size{0};
+  uint32_t element{0};
+  uint32_t key{0};
+  uint32_t first_field{0};
+  uint32_t num_fields{0};
+  // detail::fixed_packed_size, which lets decoders skip values in O(1).
+  uint32_t packed_size{0};
+
+  TI_IO_DEF(kind, size, element, key, first_field, num_fields, packed_size);
+};
+
+struct SchemaField {
+  uint32_t name_begin{0};
+  uint32_t name_size{0};
+  uint32_t type{0};
+
+  TI_IO_DEF(name_begin, name_size, type);
+};
+
+struct Schema {
+  static constexpr uint64_t kSchemaMagic = 0x414d454843534954;  // "TISCHEMA"
+
+  std::vector<SchemaType> types;
+  std::vector<SchemaField> fields;
+  std::string names;
+  // Type of each top-level value, in the order they were written.
+  std::vector<uint32_t> roots;
+  // BinarySerializerOptions::dedup_min_bytes of the writer.
+  uint64_t dedup_min_bytes{0};
+
+  std::string_view field_name(const SchemaField &field) const {
+    return std::string_view(names).substr(field.name_begin, field.name_size);
+  }
+
+  TI_IO_DEF(types, fields, names, roots, dedup_min_bytes);
+};
+
+namespace detail {
+
+template <typename T>
+struct SchemaTypeKey {
+  static constexpr char id = 0;
+};
+
+// Mirrors the overloads of `BinarySerializer::process` to describe a type.
+class SchemaBuilder {
+ public:
+  Schema schema;
+
+  explicit SchemaBuilder(const BinarySerializerOptions &options)
+      : options_(options) {
+    schema.dedup_min_bytes = options.dedup_min_bytes;
+  }
+
+  template <typename T>
+  uint32_t add() {
+    const void *key = &SchemaTypeKey<T>::id;
+    auto it = ids_.find(key);
+    if (it != ids_.end()) {
+      return it->second;
+    }
+    const auto id = static_cast<uint32_t>(schema.types.size());
+    ids_[key] = id;
+    schema.types.emplace_back();
+    // Recursion may grow `schema.types`, so no reference is held across it.
+    SchemaType type = describe<T>();
+    if (!options_.pack_bools || !fixed_layout_has_bool<T>()) {
+      type.packed_size = static_cast<uint32_t>(fixed_packed_size<T>());
+    }
+    schema.types[id] = type;
+    return id;
+  }
+
+  // Receives the fields of a struct from its `io()`.
+  template <typename T>
+  void operator()(const char *key, const T &) {
+    SchemaField field;
+    field.name_begin = static_cast<uint32_t>(schema.names.size());
+    field.name_size = static_cast<uint32_t>(std::strlen(key));
+    schema.names += key;
+    field.type = add<T>();
+    pending_fields_.push_back(field);
+  }
+
+ private:
+  template <typename T>
+  struct is_std_vector : std::false_type {};
+  template <typename T>
+  struct is_std_vector<std::vector<T>> : std::true_type {
+    using element = T;
+  };
+  template <typename T>
+  struct is_std_pair : std::false_type {};
+  template <typename K, typename V>
+  struct is_std_pair<std::pair<K, V>> : std::true_type {};
+  template <typename T>
+  struct is_std_map : std::false_type {};
+  template <typename K, typename V>
+  struct is_std_map<std::map<K, V>> : std::true_type {};
+  template <typename K, typename V>
+  struct is_std_map<std::unordered_map<K, V>> : std::true_type {};
+  template <typename K, typename V, typename C>
+  struct is_std_map<FlatMap<K, V, C>> : std::true_type {};
+  template <typename T>
+  struct is_std_set : std::false_type {};
+  template <typename K>
+  struct is_std_set<std::set<K>> : std::true_type {};
+  template <typename K>
+  struct is_std_set<std::unordered_set<K>> : std::true_type {};
+  template <typename T>
+  struct is_std_optional : std::false_type {};
+  template <typename T>
+  struct is_std_optional<std::optional<T>> : std::true_type {};
+  template <typename T>
+  struct is_std_unique_ptr : std::false_type {};
+  template <typename T>
+  struct is_std_unique_ptr<std::unique_ptr<T>> : std::true_type {};
+  template <typename T>
+  struct is_std_array : std::false_type {};
+  template <typename T, std::size_t n>
+  struct is_std_array<std::array<T, n>> : std::true_type {};
+
+  static SchemaType make(SchemaKind kind, std::size_t size = 0) {
+    SchemaType type;
+    type.kind = kind;
+    type.size = static_cast<uint32_t>(size);
+    return type;
+  }
+
+  template <typename T>
+  SchemaType describe() {
+    if constexpr (std::is_same_v<T, std::string>) {
+      return make(SchemaKind::kString);
+    } else if constexpr (std::is_array_v<T>) {
+      SchemaType type = make(SchemaKind::kArray, std::extent_v<T>);
+      type.element = add<std::remove_cv_t<std::remove_extent_t<T>>>();
+      return type;
+    } else if constexpr (std::is_same_v<T, bool>) {
+      return make(options_.pack_bools ? SchemaKind::kPackedBool
+                                      : SchemaKind::kBool,
+                  sizeof(T));
+    } else if constexpr (std::is_integral_v<T>) {
+      return make(std::is_signed_v<T> ? SchemaKind::kInt : SchemaKind::kUInt,
+                  sizeof(T));
+    } else if constexpr (std::is_floating_point_v<T>) {
+      return make(SchemaKind::kFloat, sizeof(T));
+    } else if constexpr (std::is_enum_v<T>) {
+      return describe<std::underlying_type_t<T>>();
+    } else if constexpr (std::is_pointer_v<T>) {
+      return make(SchemaKind::kPointer, sizeof(uint64_t));
+    } else if constexpr (Serializer::has_io<T>::value) {
+      return describe_struct<T>();
+    } else if constexpr (is_std_vector<T>::value) {
+      using E = typename is_std_vector<T>::element;
+      SchemaType type = make(SchemaKind::kVector);
+      if constexpr (std::is_same_v<E, float>) {
+        if (options_.float_array_encoding != FloatArrayEncoding::kRaw) {
+          type.kind = SchemaKind::kTaggedFloatArray;
+        }
+      } else if constexpr (std::is_same_v<E, int32_t> ||
+                           std::is_same_v<E, uint32_t>) {
+        if (options_.int_array_encoding != IntArrayEncoding::kRaw) {
+          type.kind = SchemaKind::kTaggedIntArray;
+        }
+      } else if constexpr (std::is_same_v<E, bool>) {
+        if (options_.pack_bools) {
+          type.kind = SchemaKind::kBitVector;
+        }
+      }
+      type.element = add<E>();
+      return type;
+    } else if constexpr (is_std_pair<T>::value) {
+      SchemaType type = make(SchemaKind::kPair);
+      type.key = add<typename T::first_type>();
+      type.element = add<typename T::second_type>();
+      return type;
+    } else if constexpr (is_std_map<T>::value) {
+      SchemaType type = make(SchemaKind::kMap);
+      type.key = add<typename T::key_type>();
+      type.element = add<typename T::mapped_type>();
+      return type;
+    } else if constexpr (is_std_set<T>::value) {
+      SchemaType type = make(SchemaKind::kSet);
+      type.element = add<typename T::key_type>();
+      return type;
+    } else if constexpr (is_std_optional<T>::value) {
+      SchemaType type = make(options_.pack_bools ? SchemaKind::kPackedOptional
+                                                 : SchemaKind::kOptional);
+      type.element = add<typename T::value_type>();
+      return type;
+    } else if constexpr (is_std_unique_ptr<T>::value) {
+      SchemaType type = make(SchemaKind::kUniquePtr);
+      type.element = add<typename T::element_type>();
+      return type;
+    } else if constexpr (is_std_array<T>::value && std::is_pod_v<T>) {
+      SchemaType type = make(SchemaKind::kArray, std::tuple_size_v<T>);
+      type.element = add<typename T::value_type>();
+      return type;
+    } else if constexpr (std::is_pod_v<T>) {
+      return make(SchemaKind::kOpaque, sizeof(T));
+    } else {
+      return make(SchemaKind::kOpaque);
+    }
+  }
+
+  // Field names are only known at runtime, from `io()` of an instance.
+  template <typename T>
+  SchemaType describe_struct() {
+    if constexpr (!std::is_default_constructible_v<T>) {
+      return make(SchemaKind::kOpaque);
+    } else {
+      std::vector<SchemaField> outer;
+      outer.swap(pending_fields_);
+      T instance{};
+      instance.io(*this);
+      outer.swap(pending_fields_);
+
+      SchemaType type = make(SchemaKind::kStruct);
+      type.first_field = static_cast<uint32_t>(schema.fields.size());
+      type.num_fields = static_cast<uint32_t>(outer.size());
+      schema.fields.insert(schema.fields.end(), outer.begin(), outer.end());
+      return type;
+    }
+  }
+
+  const BinarySerializerOptions &options_;
+  std::unordered_map<const void *, uint32_t> ids_;
+  std::vector<SchemaField> pending_fields_;
+};
+
+}  // namespace detail
+
+template <bool writing, typename ProfilingPolicy = NoProfiling>
 class BinarySerializer : public Serializer {
  private:
   template <typename T>
@@ -253,6 +878,30 @@ class BinarySerializer : public Serializer {
   std::size_t head;
   std::size_t preserved;
 
+  BinarySerializerOptions options;
+
+ private:
+  std::unique_ptr<detail::SchemaBuilder> schema_builder_;
+  // With `options.pack_bools`: offset of the byte that holds the current run
+  // of flags, and how many of its bits are taken (8 if there is none).
+  std::size_t flag_byte_{0};
+  unsigned flag_bits_used_{8};
+  // Set by `initialize_counting`: only `head` advances, nothing is stored.
+  bool counting_{false};
+  // Nesting of `operator()` calls; 0 outside of a top-level value.
+  int depth_{0};
+  // With `options.dedup_min_bytes`: (offset, size) of the first occurrence of
+  // each blob in the buffer.
+  std::unordered_map<BlobId, std::pair<std::size_t, std::size_t>, BlobIdHash>
+      blobs_;
+  // Scratch space of `process_int_array`, kept to reuse its buffers.
+  detail::DeltaBlocks delta_blocks_;
+  // Dotted path of the field being processed, for the profiling policy.
+  std::conditional_t<ProfilingPolicy::enabled, std::string, detail::Empty>
+      profile_path_;
+
+ public:
+
   using Base = Serializer;
   using Base::assets;
 
@@ -261,7 +910,7 @@ class BinarySerializer : public Serializer {
       const std::string &fn) {
     data = read_data_from_file(fn);
     c_data = reinterpret_cast<uint8_t *>(&data[0]);
-    head = sizeof(std::size_t);
+    head = sizeof(uint64_t);
   }
 
   void write_to_file(const std::string &fn) {
@@ -276,7 +925,7 @@ class BinarySerializer : public Serializer {
   void initialize(void *raw_data = nullptr,
                   std::size_t preserved_ = std::size_t(0)) {
     if constexpr (writing) {
-      std::size_t n = 0;
+      uint64_t n = 0;
       head = 0;
       if (preserved_ != 0) {
         // Preserved mode
@@ -288,7 +937,11 @@ class BinarySerializer : public Serializer {
         this->preserved = 0;
         this->c_data = nullptr;
       }
-      this->operator()("", n);
+      counting_ = false;
+      depth_ = 0;
+      flag_bits_used_ = 8;
+      blobs_.clear();
+      this->process(n);
     } else {
       if (preserved_ != 0) {
         assert(raw_data == nullptr);
@@ -298,31 +951,65 @@ class BinarySerializer : public Serializer {
         assert(raw_data != nullptr);
         c_data = reinterpret_cast<uint8_t *>(raw_data);
       }
-      head = sizeof(std::size_t);
+      head = sizeof(uint64_t);
       preserved = 0;
+      depth_ = 0;
+      flag_bits_used_ = 8;
+      blobs_.clear();
     }
   }
 
+  // Like `initialize()`, but nothing is stored. After `finalize()`, `head` is
+  // the exact size of the output, e.g. for a preserved buffer.
+  template <bool writing_ = writing>
+  std::enable_if_t<writing_, void> initialize_counting() {
+    initialize();
+    counting_ = true;
+  }
+
   void finalize() {
-    if (writing) {
-      if (c_data) {
-        *reinterpret_cast<std::size_t *>(&c_data[0]) = head;
-      } else {
-        *reinterpret_cast<std::size_t *>(&data[0]) = head;
+    if constexpr (writing) {
+      const std::size_t payload_size = head;
+      if (schema_builder_) {
+        append_schema(payload_size);
+      }
+      if (!counting_) {
+        detail::store_le<uint64_t>(c_data ? c_data : data.data(),
+                                   payload_size);
       }
     } else {
-      assert(head == *reinterpret_cast<std::size_t *>(c_data));
+      // The buffer may start at any offset, e.g. an embedded schema.
+      const auto payload_size = detail::load_le<uint64_t>(c_data);
+      assert(head == payload_size);
+      (void)payload_size;
     }
   }
 
+  // Also called for the fields of `TI_IO_DEF` structs, which are not
+  // top-level values.
   template <typename T>
-  void operator()(const char *, const T &val) {
-    this->process(val);
+  void operator()(const char *key, const T &val) {
+    if constexpr (writing) {
+      if (options.embed_schema && depth_ == 0) {
+        if (!schema_builder_) {
+          schema_builder_ = std::make_unique<detail::SchemaBuilder>(options);
+        }
+        schema_builder_->schema.roots.push_back(
+            schema_builder_->add<type::remove_cvref_t<T>>());
+      }
+    }
+    depth_++;
+    if constexpr (ProfilingPolicy::enabled) {
+      profiled_process(key, val);
+    } else {
+      this->process(val);
+    }
+    depth_--;
   }
 
   template <typename T>
   void operator()(const T &val) {
-    this->process(val);
+    (*this)("", val);
   }
 
  private:
@@ -342,7 +1029,9 @@ class BinarySerializer : public Serializer {
   // C-array
   template <typename T, std::size_t n>
   void process(const TArray<T, n> &val) {
-    if (writing) {
+    if (use_fixed_layout<T>()) {
+      process_fixed(&val[0], n);
+    } else if (writing) {
       for (std::size_t i = 0; i < n; i++) {
         this->process(val[i]);
       }
@@ -354,7 +1043,13 @@ class BinarySerializer : public Serializer {
           std::conditional_t<std::is_same<Traw, bool>::value, uint8_t, Traw>>
           tmp(n);
       for (std::size_t i = 0; i < n; i++) {
-        this->process(tmp[i]);
+        if constexpr (std::is_same_v<Traw, bool>) {
+          bool flag;
+          this->process(flag);
+          tmp[i] = flag;
+        } else {
+          this->process(tmp[i]);
+        }
       }
       std::memcpy(const_cast<typename std::remove_cv<T>::type *>(val), &tmp[0],
                   sizeof(tmp[0]) * tmp.size());
@@ -369,30 +1064,171 @@ class BinarySerializer : public Serializer {
     static_assert(!std::is_const<T>::value, "T cannot be const");
     static_assert(!std::is_volatile<T>::value, "T cannot be volatile");
     static_assert(!std::is_pointer<T>::value, "T cannot be pointer");
-    if (writing) {
-      std::size_t new_size = head + sizeof(T);
-      if (c_data) {
-        //*reinterpret_cast<typename type::remove_cvref_t<T> *>(&c_data[head]) =
-        //    val;
-        std::memcpy(&c_data[head], &val, sizeof(T));
-      } else {
-        data.resize(new_size);
-        //*reinterpret_cast<typename type::remove_cvref_t<T> *>(&data[head]) =
-        //    val;
-        std::memcpy(&data[head], &val, sizeof(T));
+    if constexpr (writing) {
+      if (uint8_t *dst = write_bytes(sizeof(T))) {
+        detail::store_fixed(dst, val);
       }
     } else {
       // get_writable(val) =
       //    *reinterpret_cast<typename std::remove_reference<T>::type *>(
       //        &c_data[head]);
-      std::memcpy(&get_writable(val), &c_data[head], sizeof(T));
+      detail::load_fixed(&c_data[head], val);
+      head += sizeof(T);
+    }
+  }
+
+  // bool, as a single bit with `options.pack_bools`
+  void process(const bool &val) {
+    if (!options.pack_bools) {
+      this->process<bool>(val);
+      return;
+    }
+    if (flag_bits_used_ == 8) {
+      flag_byte_ = head;
+      flag_bits_used_ = 0;
+      if constexpr (writing) {
+        if (uint8_t *dst = write_bytes(1)) {
+          *dst = 0;
+        }
+      } else {
+        read_bytes(1);
+      }
+    }
+    if constexpr (writing) {
+      if (!counting_) {
+        uint8_t *base = c_data ? c_data : data.data();
+        base[flag_byte_] |= uint8_t(val) << flag_bits_used_;
+      }
+    } else {
+      get_writable(val) = (c_data[flag_byte_] >> flag_bits_used_) & 1;
     }
-    head += sizeof(T);
+    flag_bits_used_++;
   }
 
   template <typename T>
   std::enable_if_t<has_io<T>::value, void> process(const T &val) {
-    val.io(*this);
+    if (use_fixed_layout<T>()) {
+      process_fixed(&val, 1);
+    } else {
+      val.io(*this);
+    }
+  }
+
+  // Whether `T` is copied as a single block, see detail::fixed_packed_size.
+  template <typename T>
+  bool use_fixed_layout() const {
+    if constexpr (detail::fixed_packed_size<T>() == 0) {
+      return false;
+    } else if constexpr (detail::fixed_layout_has_bool<T>()) {
+      return !options.pack_bools;
+    } else {
+      return true;
+    }
+  }
+
+  // Whether `n` values of `T` are deduplicated, see `dedup_min_bytes`.
+  template <typename T>
+  bool is_blob(std::size_t n) const {
+    if constexpr (std::is_enum_v<T> && detail::fixed_layout_has_bool<T>()) {
+      // Described as bools, so decoders treat them like std::vector<bool>.
+      return false;
+    } else {
+      return options.dedup_min_bytes != 0 &&
+             detail::fixed_packed_size<T>() * n >= options.dedup_min_bytes;
+    }
+  }
+
+  // `n` values of a fixed-layout type as a deduplicated blob, whose contents
+  // are what `process_fixed` would write.
+  template <typename T>
+  void process_blob(const T *val, std::size_t n) {
+    constexpr std::size_t kSize = detail::fixed_packed_size<T>();
+    const std::size_t size = kSize * n;
+    detail::BlobTag tag{detail::BlobTag::kInline};
+    BlobId id;
+    const uint8_t *contents = nullptr;
+    if constexpr (writing) {
+      std::vector<uint8_t> packed;
+      if (detail::is_packed_in_memory(val[0])) {
+        contents = reinterpret_cast<const uint8_t *>(val);
+      } else {
+        packed.resize(size);
+        detail::store_fixed_array(packed.data(), val, n);
+        contents = packed.data();
+      }
+      id = detail::hash128(contents, size);
+      if (options.blob_store != nullptr) {
+        tag = detail::BlobTag::kStored;
+        if (!counting_) {
+          options.blob_store->put(id, contents, size);
+        }
+      } else {
+        auto it = blobs_.find(id);
+        // Compared in full, so that a hash collision only costs space. There
+        // is nothing to compare with when counting; a collision then makes
+        // the count too small, which a preserved buffer reports.
+        if (it != blobs_.end() && it->second.second == size &&
+            (counting_ ||
+             std::memcmp((c_data ? c_data : data.data()) + it->second.first,
+                         contents, size) == 0)) {
+          tag = detail::BlobTag::kReference;
+        }
+      }
+      this->process(reinterpret_cast<uint8_t &>(tag));
+      this->process(id.lo);
+      this->process(id.hi);
+      if (tag == detail::BlobTag::kInline) {
+        blobs_.emplace(id, std::make_pair(head, size));
+        if (uint8_t *dst = write_bytes(size)) {
+          std::memcpy(dst, contents, size);
+        }
+      }
+    } else {
+      this->process(reinterpret_cast<uint8_t &>(tag));
+      this->process(id.lo);
+      this->process(id.hi);
+      if (tag == detail::BlobTag::kInline) {
+        blobs_.emplace(id, std::make_pair(head, size));
+        contents = read_bytes(size);
+      } else if (tag == detail::BlobTag::kReference) {
+        auto it = blobs_.find(id);
+        if (it == blobs_.end() || it->second.second != size) {
+          throw std::runtime_error("unresolved blob reference");
+        }
+        contents = c_data + it->second.first;
+      } else if (tag == detail::BlobTag::kStored) {
+        if (options.blob_store == nullptr) {
+          throw std::runtime_error("blob store required");
+        }
+        const auto stored = options.blob_store->get(id);
+        if (stored.second != size) {
+          throw std::runtime_error("blob size mismatch");
+        }
+        contents = stored.first;
+      } else {
+        throw std::runtime_error("unknown blob tag");
+      }
+      // Straight from the buffer or the store mapping into `val`.
+      detail::load_fixed_array(contents, val, n);
+    }
+  }
+
+  // `n` consecutive values of a fixed-layout type, as a single block
+  template <typename T>
+  void process_fixed(const T *val, std::size_t n) {
+    constexpr std::size_t kSize = detail::fixed_packed_size<T>();
+    if constexpr (kSize != 0) {
+      if (n == 0) {
+        return;
+      }
+      if constexpr (writing) {
+        if (uint8_t *dst = write_bytes(kSize * n)) {
+          detail::store_fixed_array(dst, val, n);
+        }
+      } else {
+        detail::load_fixed_array(read_bytes(kSize * n), val, n);
+      }
+    }
   }
 
   // Unique Pointers
@@ -408,7 +1244,7 @@ class BinarySerializer : public Serializer {
         assets.insert(std::make_pair(ptr_to_int(val.get()), val.get()));
       }
     } else {
-      std::size_t original_addr;
+      uint64_t original_addr;
       this->process(original_addr);
       if (original_addr != 0) {
         val = std::make_unique<T>();
@@ -418,9 +1254,10 @@ class BinarySerializer : public Serializer {
     }
   }
 
+  // Addresses are 64-bit on the wire, like lengths.
   template <typename T>
-  std::size_t ptr_to_int(T *t) {
-    return reinterpret_cast<std::size_t>(t);
+  uint64_t ptr_to_int(T *t) {
+    return reinterpret_cast<std::uintptr_t>(t);
   }
 
   // Unique Pointers to taichi-unit Types
@@ -457,7 +1294,7 @@ class BinarySerializer : public Serializer {
     if (writing) {
       this->process(ptr_to_int(val));
     } else {
-      std::size_t val_ptr = 0;
+      uint64_t val_ptr = 0;
       this->process(val_ptr);
       if (val_ptr != 0) {
         val = reinterpret_cast<typename std::remove_pointer<T>::type *>(
@@ -480,20 +1317,250 @@ class BinarySerializer : public Serializer {
     }
   }
 
+  // Lengths are 64-bit on the wire, whatever the size of std::size_t. Writes
+  // `n`, or reads and returns a length.
+  std::size_t process_length(std::size_t n) {
+    uint64_t length = n;
+    this->process(length);
+    if constexpr (!writing) {
+      if (length > std::numeric_limits<std::size_t>::max()) {
+        throw std::runtime_error("length exceeds the address space");
+      }
+    }
+    return static_cast<std::size_t>(length);
+  }
+
   // std::vector
   template <typename T>
   void process(const std::vector<T> &val_) {
     auto &val = get_writable(val_);
     if (writing) {
-      this->process(val.size());
+      this->process_length(val.size());
     } else {
-      std::size_t n = 0;
-      this->process(n);
+      val.resize(this->process_length(0));
+    }
+    if (use_fixed_layout<T>()) {
+      if (is_blob<T>(val.size())) {
+        process_blob(val.data(), val.size());
+      } else {
+        process_fixed(val.data(), val.size());
+      }
+    } else {
+      for (std::size_t i = 0; i < val.size(); i++) {
+        this->process(val[i]);
+      }
+    }
+  }
+
+  // std::vector<bool>, one byte per value or a bit array with
+  // `options.pack_bools`
+  void process(const std::vector<bool> &val_) {
+    auto &val = get_writable(val_);
+    const std::size_t n = this->process_length(val.size());
+    if constexpr (!writing) {
+      val.assign(n, false);
+    }
+    if (!options.pack_bools) {
+      if constexpr (writing) {
+        if (uint8_t *dst = write_bytes(n)) {
+          for (std::size_t i = 0; i < n; i++) {
+            dst[i] = val[i];
+          }
+        }
+      } else {
+        const uint8_t *src = read_bytes(n);
+        for (std::size_t i = 0; i < n; i++) {
+          val[i] = src[i] != 0;
+        }
+      }
+      return;
+    }
+    const std::size_t num_bytes = (n + 7) / 8;
+    if constexpr (writing) {
+      if (uint8_t *dst = write_bytes(num_bytes)) {
+        detail::pack_bits(val, dst);
+      }
+    } else {
+      detail::unpack_bits(read_bytes(num_bytes), val);
+    }
+  }
+
+  // std::vector<float>, optionally with a lossy encoding
+  void process(const std::vector<float> &val_) {
+    auto &val = get_writable(val_);
+    if (options.float_array_encoding == FloatArrayEncoding::kRaw) {
+      this->process<float>(val);
+      return;
+    }
+    const std::size_t n = this->process_length(val.size());
+    FloatArrayEncoding encoding = options.float_array_encoding;
+    this->process(reinterpret_cast<uint8_t &>(encoding));
+    if constexpr (!writing) {
       val.resize(n);
     }
-    for (std::size_t i = 0; i < val.size(); i++) {
-      this->process(val[i]);
+    switch (encoding) {
+      case FloatArrayEncoding::kFp16:
+        if constexpr (writing) {
+          if (uint8_t *dst = write_bytes(2 * n)) {
+            detail::float_to_half(val.data(), dst, n);
+          }
+        } else {
+          detail::half_to_float(read_bytes(2 * n), val.data(), n);
+        }
+        break;
+      case FloatArrayEncoding::kBf16:
+        if constexpr (writing) {
+          if (uint8_t *dst = write_bytes(2 * n)) {
+            detail::float_to_bf16(val.data(), dst, n);
+          }
+        } else {
+          detail::bf16_to_float(read_bytes(2 * n), val.data(), n);
+        }
+        break;
+      case FloatArrayEncoding::kQuant8:
+        process_quantized<uint8_t>(val);
+        break;
+      case FloatArrayEncoding::kQuant16:
+        process_quantized<uint16_t>(val);
+        break;
+      default:
+        throw std::runtime_error("unknown float array encoding");
+    }
+  }
+
+  template <typename Q>
+  void process_quantized(std::vector<float> &val) {
+    const std::size_t n = val.size();
+    float lo = 0.0f, hi = 0.0f;
+    if constexpr (writing) {
+      detail::float_range(val.data(), n, lo, hi);
+    }
+    this->process(lo);
+    this->process(hi);
+    if constexpr (writing) {
+      if (uint8_t *dst = write_bytes(sizeof(Q) * n)) {
+        detail::float_to_quantized<Q>(val.data(), dst, n, lo, hi);
+      }
+    } else {
+      detail::quantized_to_float<Q>(read_bytes(sizeof(Q) * n), val.data(), n,
+                                    lo, hi);
+    }
+  }
+
+  // std::vector<int32_t>, optionally delta coded and bit-packed
+  void process(const std::vector<int32_t> &val) {
+    process_int_array(val);
+  }
+
+  // std::vector<uint32_t>, optionally delta coded and bit-packed
+  void process(const std::vector<uint32_t> &val) {
+    process_int_array(val);
+  }
+
+  template <typename T>
+  void process_int_array(const std::vector<T> &val_) {
+    static_assert(sizeof(T) == sizeof(uint32_t), "");
+    auto &val = get_writable(val_);
+    if (options.int_array_encoding == IntArrayEncoding::kRaw) {
+      this->process<T>(val);
+      return;
+    }
+    const std::size_t n = this->process_length(val.size());
+    IntArrayEncoding encoding = options.int_array_encoding;
+    if constexpr (writing) {
+      if (encoding == IntArrayEncoding::kAuto) {
+        encoding = detail::delta_bitpacking_worthwhile(
+                       reinterpret_cast<const uint32_t *>(val.data()), n)
+                       ? IntArrayEncoding::kDeltaBitPacked
+                       : IntArrayEncoding::kRaw;
+      }
+    }
+    this->process(reinterpret_cast<uint8_t &>(encoding));
+    if constexpr (!writing) {
+      val.resize(n);
+    }
+    auto *ptr = reinterpret_cast<uint32_t *>(val.data());
+    if (encoding == IntArrayEncoding::kDeltaBitPacked) {
+      if constexpr (writing) {
+        detail::delta_blocks(ptr, n, delta_blocks_);
+        if (uint8_t *dst = write_bytes(delta_blocks_.packed_size)) {
+          detail::delta_bitpack(delta_blocks_, dst);
+        }
+      } else {
+        head += detail::delta_bitunpack(&c_data[head], n, ptr);
+      }
+    } else if (encoding == IntArrayEncoding::kRaw) {
+      if constexpr (writing) {
+        if (uint8_t *dst = write_bytes(sizeof(T) * n)) {
+          detail::copy_le<T>(dst, ptr, n);
+        }
+      } else {
+        detail::copy_le<T>(ptr, read_bytes(sizeof(T) * n), n);
+      }
+    } else {
+      throw std::runtime_error("unknown int array encoding");
+    }
+  }
+
+  template <typename T>
+  void profiled_process(const char *key, const T &val) {
+    const std::size_t path_size = profile_path_.size();
+    if (*key != '\0') {
+      if (path_size != 0) {
+        profile_path_ += '.';
+      }
+      profile_path_ += key;
+    }
+    const std::size_t head_before = head;
+    const auto start = std::chrono::steady_clock::now();
+    this->process(val);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    ProfilingPolicy::template record<T>(
+        profile_path_, head - head_before, detail::element_count<T>::get(val),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    profile_path_.resize(path_size);
+  }
+
+  void append_schema(std::size_t payload_size) {
+    BinarySerializer<true> schema_writer;
+    schema_writer.initialize();
+    schema_writer(schema_builder_->schema);
+    schema_writer.finalize();
+    schema_builder_.reset();
+
+    if (uint8_t *dst = write_bytes(schema_writer.head)) {
+      std::memcpy(dst, schema_writer.data.data(), schema_writer.head);
     }
+    uint64_t trailer[2] = {payload_size, Schema::kSchemaMagic};
+    this->process(trailer);
+  }
+
+  // Appends `size` bytes and returns where they start. Only valid until the
+  // next write, since the backing std::vector may reallocate. Returns nullptr
+  // when counting, in which case there is nothing to store.
+  uint8_t *write_bytes(std::size_t size) {
+    static_assert(writing, "");
+    uint8_t *ptr;
+    if (c_data) {
+      if (size > preserved - head) {
+        throw std::runtime_error("preserved buffer too small");
+      }
+      ptr = &c_data[head];
+    } else if (counting_) {
+      ptr = nullptr;
+    } else {
+      data.resize(head + size);
+      ptr = &data[head];
+    }
+    head += size;
+    return ptr;
+  }
+
+  const uint8_t *read_bytes(std::size_t size) {
+    static_assert(!writing, "");
+    const uint8_t *ptr = &c_data[head];
+    head += size;
+    return ptr;
   }
 
   // std::pair
@@ -515,6 +1582,37 @@ class BinarySerializer : public Serializer {
     handle_associative_container(val);
   }
 
+  // FlatMap, read into its vector in one pass and sorted only if needed
+  template <typename K, typename V, typename C>
+  void process(const FlatMap<K, V, C> &val) {
+    if constexpr (writing) {
+      handle_associative_container(val);
+    } else {
+      auto &wval = get_writable(val);
+      // Reuses the allocation of the current contents.
+      auto entries = wval.extract();
+      entries.clear();
+      entries.resize(this->process_length(0));
+      for (auto &entry : entries) {
+        this->process(entry.first);
+        this->process(entry.second);
+      }
+      wval.adopt(std::move(entries));
+    }
+  }
+
+  // std::set
+  template <typename K>
+  void process(const std::set<K> &val) {
+    handle_set(val);
+  }
+
+  // std::unordered_set
+  template <typename K>
+  void process(const std::unordered_set<K> &val) {
+    handle_set(val);
+  }
+
   // std::optional
   template <typename T>
   void process(const std::optional<T> &val) {
@@ -540,21 +1638,47 @@ class BinarySerializer : public Serializer {
   template <typename M>
   void handle_associative_container(const M &val) {
     if constexpr (writing) {
-      this->process(val.size());
+      this->process_length(val.size());
       for (auto &iter : val) {
-        auto first = iter.first;
-        this->process(first);
+        this->process(iter.first);
         this->process(iter.second);
       }
     } else {
       auto &wval = get_writable(val);
       wval.clear();
-      std::size_t n = 0;
-      this->process(n);
+      const std::size_t n = this->process_length(0);
+      if constexpr (detail::has_reserve<M>::value) {
+        wval.reserve(n);
+      }
+      for (std::size_t i = 0; i < n; i++) {
+        typename M::key_type key{};
+        this->process(key);
+        // Ordered containers are written in key order, so inserting at the
+        // end is O(1). The value is read in place.
+        auto it = wval.try_emplace(wval.end(), std::move(key));
+        this->process(it->second);
+      }
+    }
+  }
+
+  template <typename S>
+  void handle_set(const S &val) {
+    if constexpr (writing) {
+      this->process_length(val.size());
+      for (auto &key : val) {
+        this->process(key);
+      }
+    } else {
+      auto &wval = get_writable(val);
+      wval.clear();
+      const std::size_t n = this->process_length(0);
+      if constexpr (detail::has_reserve<S>::value) {
+        wval.reserve(n);
+      }
       for (std::size_t i = 0; i < n; i++) {
-        typename M::value_type record;
-        this->process(record);
-        wval.insert(std::move(record));
+        typename S::key_type key{};
+        this->process(key);
+        wval.emplace_hint(wval.end(), std::move(key));
       }
     }
   }
@@ -564,7 +1688,8 @@ using BinaryOutputSerializer = BinarySerializer<true>;
 using BinaryInputSerializer = BinarySerializer<false>;
 
 // Serialize to JSON format
-class TextSerializer : public Serializer {
+template <typename ProfilingPolicy>
+class BasicTextSerializer : public Serializer {
  public:
   std::string data;
   void print() const {
@@ -581,6 +1706,11 @@ class TextSerializer : public Serializer {
   int indent_;
   static constexpr int indent_width = 2;
   bool first_line_;
+  // Minified output: no line breaks, indentation or spaces after separators.
+  bool compact_;
+  // Dotted path of the field being processed, for the profiling policy.
+  std::conditional_t<ProfilingPolicy::enabled, std::string, detail::Empty>
+      profile_path_;
 
   template <typename T>
   inline static constexpr bool is_elementary_type_v =
@@ -588,14 +1718,17 @@ class TextSerializer : public Serializer {
       std::is_pod_v<T>;
 
  public:
-  TextSerializer() {
+  explicit BasicTextSerializer(bool compact = false) {
     indent_ = 0;
     first_line_ = false;
+    compact_ = compact;
   }
 
   template <typename T>
-  static std::string serialize(const char *key, const T &t) {
-    TextSerializer ser;
+  static std::string serialize(const char *key,
+                               const T &t,
+                               bool compact = false) {
+    BasicTextSerializer ser(compact);
     ser(key, t);
     return ser.data;
   }
@@ -603,7 +1736,11 @@ class TextSerializer : public Serializer {
   template <typename T>
   void operator()(const char *key, const T &t, bool append_comma = false) {
     add_key(key);
-    process(t);
+    if constexpr (ProfilingPolicy::enabled) {
+      profiled_process(key, t);
+    } else {
+      process(t);
+    }
     if (append_comma) {
       add_raw(",");
     }
@@ -619,7 +1756,7 @@ class TextSerializer : public Serializer {
 
  private:
   void process(const std::string &val) {
-    add_raw("\"" + val + "\"");
+    detail::append_json_string(data, val);
   }
 
   template <typename T, std::size_t n>
@@ -631,16 +1768,7 @@ class TextSerializer : public Serializer {
   template <typename T, std::size_t n>
   std::enable_if_t<is_compact<T, n>::value, void> process(
       const TArray<T, n> &val) {
-    std::stringstream ss;
-    ss << "{";
-    for (std::size_t i = 0; i < n; i++) {
-      ss << val[i];
-      if (i != n - 1) {
-        ss << ", ";
-      }
-    }
-    ss << "}";
-    add_raw(ss.str());
+    process_inline_array(&val[0], n);
   }
 
   // C-array
@@ -650,7 +1778,7 @@ class TextSerializer : public Serializer {
     add_raw("{");
     indent_++;
     for (std::size_t i = 0; i < n; i++) {
-      add_key(std::to_string(i).c_str());
+      add_index_key(i);
       process(val[i]);
       if (i != n - 1) {
         add_raw(",");
@@ -664,16 +1792,7 @@ class TextSerializer : public Serializer {
   template <typename T, std::size_t n>
   std::enable_if_t<is_compact<T, n>::value, void> process(
       const StdTArray<T, n> &val) {
-    std::stringstream ss;
-    ss << "{";
-    for (std::size_t i = 0; i < n; i++) {
-      ss << val[i];
-      if (i != n - 1) {
-        ss << ", ";
-      }
-    }
-    ss << "}";
-    add_raw(ss.str());
+    process_inline_array(&val[0], n);
   }
 
   // std::array
@@ -683,7 +1802,7 @@ class TextSerializer : public Serializer {
     add_raw("{");
     indent_++;
     for (std::size_t i = 0; i < n; i++) {
-      add_key(std::to_string(i).c_str());
+      add_index_key(i);
       process(val[i]);
       if (i != n - 1) {
         add_raw(",");
@@ -697,9 +1816,32 @@ class TextSerializer : public Serializer {
   template <typename T>
   std::enable_if_t<is_elementary_type_v<T>, void> process(const T &val) {
     static_assert(!has_io<T>::value, "");
-    std::stringstream ss;
-    ss << std::boolalpha << val;
-    add_raw(ss.str());
+    if constexpr (std::is_same_v<T, bool>) {
+      data += val ? "true" : "false";
+    } else if constexpr (std::is_integral_v<T>) {
+      // Also covers the character types, which a stream would print as text.
+      char buf[24];
+      const auto res = std::to_chars(
+          buf, buf + sizeof(buf),
+          std::conditional_t<std::is_signed_v<T>, long long,
+                             unsigned long long>(val));
+      data.append(buf, res.ptr);
+    } else if constexpr (std::is_floating_point_v<T>) {
+      if (!std::isfinite(val)) {
+        // JSON has no representation for these.
+        data += "null";
+        return;
+      }
+      // Same as the default stream formatting.
+      char buf[32];
+      const int len =
+          std::snprintf(buf, sizeof(buf), "%g", static_cast<double>(val));
+      data.append(buf, len);
+    } else {
+      std::stringstream ss;
+      ss << val;
+      add_raw(ss.str());
+    }
   }
 
   template <typename T>
@@ -744,9 +1886,9 @@ class TextSerializer : public Serializer {
   void process(const std::pair<T, G> &val) {
     add_raw("[");
     indent_++;
-    process("first", val.first);
-    add_raw(", ");
-    process("second", val.second);
+    process(val.first);
+    add_raw(compact_ ? "," : ", ");
+    process(val.second);
     indent_--;
     add_raw("]");
   }
@@ -763,6 +1905,24 @@ class TextSerializer : public Serializer {
     handle_associative_container(val);
   }
 
+  // FlatMap
+  template <typename K, typename V, typename C>
+  void process(const FlatMap<K, V, C> &val) {
+    handle_associative_container(val);
+  }
+
+  // std::set
+  template <typename K>
+  void process(const std::set<K> &val) {
+    handle_set(val);
+  }
+
+  // std::unordered_set
+  template <typename K>
+  void process(const std::unordered_set<K> &val) {
+    handle_set(val);
+  }
+
   // std::optional
   template <typename T>
   void process(const std::optional<T> &val) {
@@ -784,17 +1944,17 @@ class TextSerializer : public Serializer {
     add_raw("{");
     indent_++;
     for (auto iter = val.begin(); iter != val.end(); iter++) {
-      auto first = iter->first;
-      bool is_string = typeid(first) == typeid(std::string);
+      constexpr bool is_string =
+          std::is_same_v<typename M::key_type, std::string>;
       // Non-string keys must be wrapped by quotes.
       if (!is_string) {
         add_raw("\"");
       }
-      process(first);
+      process(iter->first);
       if (!is_string) {
         add_raw("\"");
       }
-      add_raw(": ");
+      add_raw(compact_ ? ":" : ": ");
       process(iter->second);
       if (std::next(iter) != val.end()) {
         add_raw(",");
@@ -804,19 +1964,72 @@ class TextSerializer : public Serializer {
     add_raw("}");
   }
 
-  void add_raw(const std::string &str) {
+  template <typename S>
+  void handle_set(const S &val) {
+    add_raw("[");
+    indent_++;
+    for (auto iter = val.begin(); iter != val.end(); iter++) {
+      process(*iter);
+      if (std::next(iter) != val.end()) {
+        add_raw(",");
+      }
+    }
+    indent_--;
+    add_raw("]");
+  }
+
+  template <typename T>
+  void profiled_process(const char *key, const T &val) {
+    const std::size_t path_size = profile_path_.size();
+    if (path_size != 0) {
+      profile_path_ += '.';
+    }
+    profile_path_ += key;
+    const std::size_t size_before = data.size();
+    const auto start = std::chrono::steady_clock::now();
+    process(val);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    ProfilingPolicy::template record<T>(
+        profile_path_, data.size() - size_before,
+        detail::element_count<T>::get(val),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    profile_path_.resize(path_size);
+  }
+
+  // Arrays of a few numbers go on one line.
+  template <typename T>
+  void process_inline_array(const T *val, std::size_t n) {
+    add_raw("[");
+    for (std::size_t i = 0; i < n; i++) {
+      process(val[i]);
+      if (i != n - 1) {
+        add_raw(compact_ ? "," : ", ");
+      }
+    }
+    add_raw("]");
+  }
+
+  void add_raw(std::string_view str) {
     data += str;
   }
 
-  void add_key(const std::string &key) {
-    if (first_line_) {
-      first_line_ = false;
-    } else {
-      data += "\n";
+  void add_key(std::string_view key) {
+    if (!compact_) {
+      if (first_line_) {
+        first_line_ = false;
+      } else {
+        data += '\n';
+      }
+      data.append(indent_width * indent_, ' ');
     }
-    data += std::string(indent_width * indent_, ' ') + "\"" + key + "\"";
+    detail::append_json_string(data, key);
+    add_raw(compact_ ? ":" : ": ");
+  }
 
-    add_raw(": ");
+  void add_index_key(std::size_t i) {
+    char buf[24];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), i);
+    add_key(std::string_view(buf, res.ptr - buf));
   }
 };
 
@@ -844,6 +2057,19 @@ void write_to_binary_file(const T &t, const std::string &file_name) {
   writer.write_to_file(file_name);
 }
 
+// The number of bytes `t` takes when serialized with `options`, without
+// storing it anywhere.
+template <typename T>
+std::size_t serialized_size(const T &t,
+                            const BinarySerializerOptions &options = {}) {
+  BinaryOutputSerializer counter;
+  counter.options = options;
+  counter.initialize_counting();
+  counter(t);
+  counter.finalize();
+  return counter.head;
+}
+
 // Compile-Time Tests
 static_assert(std::is_same<decltype(Serializer::get_writable(
                                std::declval<const std::vector<int> &>())),
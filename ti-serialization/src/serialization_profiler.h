@@ -0,0 +1,337 @@
+/*******************************************************************************
+    Copyright (c) The Taichi Authors (2016- ). All Rights Reserved.
+    The use of this software is governed by the LICENSE file.
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "json_escape.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//                     Profiling policies for serializers                     //
+////////////////////////////////////////////////////////////////////////////////
+
+// The serializers take a profiling policy as a template argument. It is asked
+// for `enabled` at compile time, and only if that is true, `record<T>()` is
+// called after each field and top-level value with the number of bytes
+// written (or read), the number of elements and the inclusive time.
+//
+//   BinarySerializer<true, ThreadLocalProfiling> writer;
+//   ...
+//   SerializationProfiler::print_report(std::cout);
+
+// The default; compiles to nothing.
+struct NoProfiling {
+  static constexpr bool enabled = false;
+
+  template <typename T>
+  static void record(std::string_view,
+                     std::size_t,
+                     std::size_t,
+                     uint64_t) {
+  }
+};
+
+namespace detail {
+
+// The name of `T` as spelled by the compiler, without RTTI.
+template <typename T>
+constexpr std::string_view type_name() {
+#if defined(_MSC_VER)
+  std::string_view name = __FUNCSIG__;
+  const std::string_view prefix = "type_name<";
+  const std::string_view suffix = ">(void)";
+#else
+  std::string_view name = __PRETTY_FUNCTION__;
+  const std::string_view prefix = "T = ";
+  const std::string_view suffix = "]";
+#endif
+  name.remove_prefix(name.find(prefix) + prefix.size());
+  name.remove_suffix(name.size() - name.rfind(suffix));
+#if !defined(_MSC_VER)
+  // GCC appends "; std::string_view = ..." to the template arguments.
+  name = name.substr(0, name.find(';'));
+#endif
+  return name;
+}
+
+}  // namespace detail
+
+// Collects counters per C++ type and per field path. Each thread counts into
+// its own tables; reports merge them. A thread only takes its own lock, and
+// only the first time it sees a type or path.
+class SerializationProfiler {
+ public:
+  struct Counter {
+    uint64_t calls{0};
+    uint64_t bytes{0};
+    uint64_t elements{0};
+    uint64_t nanoseconds{0};
+
+    void add(const Counter &other) {
+      calls += other.calls;
+      bytes += other.bytes;
+      elements += other.elements;
+      nanoseconds += other.nanoseconds;
+    }
+  };
+
+  struct Entry {
+    std::string name;
+    Counter counter;
+  };
+
+  struct Report {
+    // Both sorted by descending time.
+    std::vector<Entry> types;
+    std::vector<Entry> paths;
+  };
+
+  template <typename T>
+  static void record(std::string_view path,
+                     std::size_t bytes,
+                     std::size_t elements,
+                     uint64_t nanoseconds) {
+    const Counter delta{1, bytes, elements, nanoseconds};
+    Local &l = local();
+    // One lookup per thread and type; the nodes are stable.
+    thread_local SharedCounter *type_counter =
+        &l.types.find_or_add(detail::type_name<T>(), l.mutex);
+    type_counter->add(delta);
+    l.paths.find_or_add(path.empty() ? "(root)" : path, l.mutex).add(delta);
+  }
+
+  static Report report() {
+    Global &global = Global::instance();
+    std::lock_guard<std::mutex> lock(global.mutex);
+    Totals types = global.retired_types;
+    Totals paths = global.retired_paths;
+    for (Local *l : global.live) {
+      std::lock_guard<std::mutex> local_lock(l->mutex);
+      l->types.add_to(types);
+      l->paths.add_to(paths);
+    }
+    return {sorted(types), sorted(paths)};
+  }
+
+  static void reset() {
+    Global &global = Global::instance();
+    std::lock_guard<std::mutex> lock(global.mutex);
+    global.retired_types.clear();
+    global.retired_paths.clear();
+    for (Local *l : global.live) {
+      std::lock_guard<std::mutex> local_lock(l->mutex);
+      l->types.clear();
+      l->paths.clear();
+    }
+  }
+
+  static void print_report(std::ostream &os) {
+    const Report r = report();
+    os << "Serialization profile (inclusive time)" << std::endl;
+    print_table(os, "type", r.types);
+    print_table(os, "field", r.paths);
+  }
+
+  static std::string report_json() {
+    const Report r = report();
+    std::string out = "{\"types\":";
+    append_json(out, r.types);
+    out += ",\"paths\":";
+    append_json(out, r.paths);
+    out += "}";
+    return out;
+  }
+
+ private:
+  using Totals = std::unordered_map<std::string, Counter>;
+
+  // A Counter that the owning thread adds to while reports read it.
+  struct SharedCounter {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> elements{0};
+    std::atomic<uint64_t> nanoseconds{0};
+
+    void add(const Counter &delta) {
+      calls.fetch_add(delta.calls, std::memory_order_relaxed);
+      bytes.fetch_add(delta.bytes, std::memory_order_relaxed);
+      elements.fetch_add(delta.elements, std::memory_order_relaxed);
+      nanoseconds.fetch_add(delta.nanoseconds, std::memory_order_relaxed);
+    }
+
+    Counter load() const {
+      return {calls.load(std::memory_order_relaxed),
+              bytes.load(std::memory_order_relaxed),
+              elements.load(std::memory_order_relaxed),
+              nanoseconds.load(std::memory_order_relaxed)};
+    }
+
+    void clear() {
+      calls.store(0, std::memory_order_relaxed);
+      bytes.store(0, std::memory_order_relaxed);
+      elements.store(0, std::memory_order_relaxed);
+      nanoseconds.store(0, std::memory_order_relaxed);
+    }
+  };
+
+  // Counters of one thread by name. Nodes are only ever added, so counters
+  // and names stay where they are, and the index is keyed by views of the
+  // names: looking up a known name does not allocate.
+  class Table {
+   public:
+    // Only called by the owning thread, which is the only one that adds
+    // nodes, so that the lookup needs no lock. Adding takes `mutex`, which
+    // reports hold while they walk the nodes.
+    SharedCounter &find_or_add(std::string_view name, std::mutex &mutex) {
+      auto it = index_.find(name);
+      if (it != index_.end()) {
+        return *it->second;
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      Node &node = nodes_.emplace_back(name);
+      index_.emplace(node.name, &node.counter);
+      return node.counter;
+    }
+
+    // The callers hold the owner's mutex.
+    void add_to(Totals &totals) const {
+      for (const Node &node : nodes_) {
+        totals[node.name].add(node.counter.load());
+      }
+    }
+
+    void clear() {
+      for (Node &node : nodes_) {
+        node.counter.clear();
+      }
+    }
+
+   private:
+    struct Node {
+      explicit Node(std::string_view name) : name(name) {
+      }
+
+      std::string name;
+      SharedCounter counter;
+    };
+
+    std::deque<Node> nodes_;
+    std::unordered_map<std::string_view, SharedCounter *> index_;
+  };
+
+  struct Local;
+
+  struct Global {
+    std::mutex mutex;
+    std::vector<Local *> live;
+    // Counters of threads that have exited.
+    Totals retired_types;
+    Totals retired_paths;
+
+    static Global &instance() {
+      static Global global;
+      return global;
+    }
+  };
+
+  // Registers the thread's tables for reports for as long as it lives.
+  struct Local {
+    std::mutex mutex;
+    Table types;
+    Table paths;
+
+    Local() {
+      Global &global = Global::instance();
+      std::lock_guard<std::mutex> lock(global.mutex);
+      global.live.push_back(this);
+    }
+
+    ~Local() {
+      Global &global = Global::instance();
+      std::lock_guard<std::mutex> lock(global.mutex);
+      types.add_to(global.retired_types);
+      paths.add_to(global.retired_paths);
+      global.live.erase(
+          std::find(global.live.begin(), global.live.end(), this));
+    }
+  };
+
+  static Local &local() {
+    thread_local Local l;
+    return l;
+  }
+
+  static std::vector<Entry> sorted(const Totals &table) {
+    std::vector<Entry> entries;
+    for (const auto &[name, counter] : table) {
+      if (counter.calls != 0) {
+        entries.push_back({name, counter});
+      }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) {
+                return a.counter.nanoseconds > b.counter.nanoseconds;
+              });
+    return entries;
+  }
+
+  static void print_table(std::ostream &os,
+                          const char *title,
+                          const std::vector<Entry> &entries) {
+    char line[128];
+    std::snprintf(line, sizeof(line), "%12s %14s %12s %12s  %s", "calls",
+                  "bytes", "elements", "time (ms)", title);
+    os << line << std::endl;
+    for (const Entry &e : entries) {
+      std::snprintf(line, sizeof(line), "%12llu %14llu %12llu %12.3f  ",
+                    (unsigned long long)e.counter.calls,
+                    (unsigned long long)e.counter.bytes,
+                    (unsigned long long)e.counter.elements,
+                    e.counter.nanoseconds * 1e-6);
+      os << line << e.name << std::endl;
+    }
+  }
+
+  static void append_json(std::string &out, const std::vector<Entry> &entries) {
+    out += "[";
+    for (std::size_t i = 0; i < entries.size(); i++) {
+      const Counter &c = entries[i].counter;
+      if (i != 0) {
+        out += ",";
+      }
+      out += "{\"name\":";
+      detail::append_json_string(out, entries[i].name);
+      out += ",\"calls\":" + std::to_string(c.calls) +
+             ",\"bytes\":" + std::to_string(c.bytes) +
+             ",\"elements\":" + std::to_string(c.elements) +
+             ",\"nanoseconds\":" + std::to_string(c.nanoseconds) + "}";
+    }
+    out += "]";
+  }
+};
+
+// Counts into `SerializationProfiler`.
+struct ThreadLocalProfiling {
+  static constexpr bool enabled = true;
+
+  template <typename T>
+  static void record(std::string_view path,
+                     std::size_t bytes,
+                     std::size_t elements,
+                     uint64_t nanoseconds) {
+    SerializationProfiler::record<T>(path, bytes, elements, nanoseconds);
+  }
+};